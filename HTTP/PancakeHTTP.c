@@ -2,6 +2,7 @@
 #include "../PancakeConfiguration.h"
 #include "../PancakeLogger.h"
 #include "../PancakeDateTime.h"
+#include "../PancakeStatistics.h"
 
 #ifdef PANCAKE_HTTPREWRITE
 #include "../HTTPRewrite/PancakeHTTPRewrite.h"
@@ -11,7 +12,7 @@ PancakeModule PancakeHTTP = {
 		"HTTP",
 		PancakeHTTPInitialize,
 		PancakeHTTPCheckConfiguration,
-		NULL,
+		PancakeHTTPShutdown,
 		0
 };
 
@@ -528,6 +529,8 @@ PancakeHTTPVirtualHostIndex *PancakeHTTPVirtualHosts = NULL;
 PancakeHTTPVirtualHost *PancakeHTTPDefaultVirtualHost = NULL;
 PancakeHTTPConfigurationStructure PancakeHTTPConfiguration;
 UInt16 PancakeHTTPNumVirtualHosts = 0;
+PancakePool PancakeHTTPRequestPool = PancakePoolInitializer(sizeof(PancakeHTTPRequest), 64);
+PancakePool PancakeHTTPHeaderPool = PancakePoolInitializer(sizeof(PancakeHTTPHeader), 256);
 static UByte PancakeHTTPNetworking = 0;
 
 static PancakeHTTPContentServeBackend *contentBackends = NULL;
@@ -863,6 +866,13 @@ UByte PancakeHTTPCheckConfiguration() {
 	return 1;
 }
 
+UByte PancakeHTTPShutdown() {
+	PancakePoolDestroy(&PancakeHTTPRequestPool);
+	PancakePoolDestroy(&PancakeHTTPHeaderPool);
+
+	return 1;
+}
+
 STATIC inline void PancakeHTTPInitializeRequestStructure(PancakeHTTPRequest *request) {
 	request->method = 0;
 	request->headers = NULL;
@@ -878,43 +888,51 @@ STATIC inline void PancakeHTTPInitializeRequestStructure(PancakeHTTPRequest *req
 	request->acceptEncoding.length = 0;
 	request->authorization.length = 0;
 	request->clientContentLength = 0;
-	request->schedulerEvent = NULL;
 	request->userAgent.length = 0;
 
 	PancakeConfigurationInitializeScopeGroup(&request->scopeGroup);
 }
 
 STATIC void PancakeHTTPInitializeConnection(PancakeSocket *sock) {
-	PancakeSocket *client = PancakeNetworkAcceptConnection(sock);
-	PancakeHTTPRequest *request;
+	Int32 i = 0;
 
-	if(client == NULL) {
-		return;
-	}
+	// Accept up to AcceptBatch connections per event to save wait round trips
+	do {
+		PancakeSocket *client = PancakeNetworkAcceptConnection(sock);
+		PancakeHTTPRequest *request;
 
-	request = PancakeAllocate(sizeof(PancakeHTTPRequest));
-	PancakeHTTPInitializeRequestStructure(request);
+		// No more pending connections
+		if(client == NULL) {
+			return;
+		}
 
-	request->socket = client;
+		request = PancakePoolAllocate(&PancakeHTTPRequestPool);
+		PancakeHTTPInitializeRequestStructure(request);
 
-	client->onRead = PancakeHTTPReadHeaderData;
-	client->onRemoteHangup = PancakeHTTPOnRemoteHangup;
-	client->data = (void*) request;
+		request->socket = client;
 
-	PancakeNetworkAddReadSocket(client);
-	PancakeHTTPReadHeaderData(client);
+		client->onRead = PancakeHTTPReadHeaderData;
+		client->onRemoteHangup = PancakeHTTPOnRemoteHangup;
+		client->data = (void*) request;
+
+		PancakeNetworkAddReadSocket(client);
+		PancakeHTTPReadHeaderData(client);
+	} while(++i < PancakeMainConfiguration.acceptBatch);
 }
 
 STATIC void PancakeHTTPInitializeKeepAliveConnection(PancakeSocket *sock) {
 	PancakeHTTPRequest *request;
 
-	request = PancakeAllocate(sizeof(PancakeHTTPRequest));
+	request = PancakePoolAllocate(&PancakeHTTPRequestPool);
 	PancakeHTTPInitializeRequestStructure(request);
 
 	request->socket = sock;
 
-	// Unschedule keep-alive timeout event
-	PancakeUnschedule((PancakeSchedulerEvent*) sock->data);
+	// Keep-alive timeout is dropped lazily
+	PancakeNetworkClearTimeout(sock);
+	PancakeNetworkSetIdle(sock, 0);
+
+	PancakeStatisticsIncrement(keepAliveReuses);
 
 	sock->onRead = PancakeHTTPReadHeaderData;
 	sock->onRemoteHangup = PancakeHTTPOnRemoteHangup;
@@ -935,7 +953,7 @@ STATIC inline void PancakeHTTPCleanRequestData(PancakeHTTPRequest *request) {
 	}
 
 	LL_FOREACH_SAFE(request->headers, header, tmp) {
-		PancakeFree(header);
+		PancakePoolFree(&PancakeHTTPHeaderPool, header);
 	}
 
 	PancakeConfigurationDestroyScopeGroup(&request->scopeGroup);
@@ -947,7 +965,7 @@ STATIC void PancakeHTTPOnClientTimeout(PancakeSocket *sock) {
 	if(request != NULL) {
 		PancakeHTTPCleanRequestData(request);
 
-		PancakeFree(sock->data);
+		PancakePoolFree(&PancakeHTTPRequestPool, sock->data);
 	}
 
 	PancakeNetworkClose(sock);
@@ -1015,8 +1033,8 @@ STATIC void PancakeHTTPReadHeaderData(PancakeSocket *sock) {
 
 			while(ptr = memchr(ptr, '\r', sock->readBuffer.value + sock->readBuffer.length - ptr)) {
 				if(sock->readBuffer.value + sock->readBuffer.length - ptr < 3) {
-					if(!request->schedulerEvent) {
-						request->schedulerEvent = PancakeSchedule(time(NULL) + PancakeHTTPConfiguration.requestTimeout, (PancakeSchedulerEventCallback) PancakeHTTPOnClientTimeout, sock);
+					if(!sock->deadline) {
+						PancakeNetworkSetTimeout(sock, PancakeHTTPConfiguration.requestTimeout * 1000, PancakeHTTPOnClientTimeout);
 					}
 
 					return;
@@ -1031,8 +1049,8 @@ STATIC void PancakeHTTPReadHeaderData(PancakeSocket *sock) {
 			}
 
 			if(ptr == NULL) {
-				if(!request->schedulerEvent) {
-					request->schedulerEvent = PancakeSchedule(time(NULL) + PancakeHTTPConfiguration.requestTimeout, (PancakeSchedulerEventCallback) PancakeHTTPOnClientTimeout, sock);
+				if(!sock->deadline) {
+					PancakeNetworkSetTimeout(sock, PancakeHTTPConfiguration.requestTimeout * 1000, PancakeHTTPOnClientTimeout);
 				}
 
 				return;
@@ -1044,18 +1062,15 @@ STATIC void PancakeHTTPReadHeaderData(PancakeSocket *sock) {
 			offset = sock->readBuffer.value + (request->method == PANCAKE_HTTP_HEAD ? 5 : 4); // 5 = "HEAD "; 4 = "GET "
 			headerEnd = sock->readBuffer.value + sock->readBuffer.length - 4;
 		} else {
-			if(!request->schedulerEvent) {
-				request->schedulerEvent = PancakeSchedule(time(NULL) + PancakeHTTPConfiguration.requestTimeout, (PancakeSchedulerEventCallback) PancakeHTTPOnClientTimeout, sock);
+			if(!sock->deadline) {
+				PancakeNetworkSetTimeout(sock, PancakeHTTPConfiguration.requestTimeout * 1000, PancakeHTTPOnClientTimeout);
 			}
 
 			return;
 		}
 
-		// Unschedule timeout event
-		if(request->schedulerEvent) {
-			PancakeUnschedule(request->schedulerEvent);
-			request->schedulerEvent = NULL;
-		}
+		// Header data is complete
+		PancakeNetworkClearTimeout(sock);
 
 		// Lookup end of request URI
 		ptr = memchr(offset, ' ', headerEnd - offset);
@@ -1226,7 +1241,7 @@ STATIC void PancakeHTTPReadHeaderData(PancakeSocket *sock) {
 						goto StoreHeader;
 					default:
 					StoreHeader:
-						header = PancakeAllocate(sizeof(PancakeHTTPHeader));
+						header = PancakePoolAllocate(&PancakeHTTPHeaderPool);
 						header->name.value = offset;
 						header->name.length = ptr2 - offset;
 						header->value.value = ptr3;
@@ -1340,8 +1355,8 @@ STATIC void PancakeHTTPReadHeaderData(PancakeSocket *sock) {
 		// No content available
 		PancakeHTTPException(sock, 500);
 		PancakeConfigurationUnscope();
-	} else if(!request->schedulerEvent) {
-		request->schedulerEvent = PancakeSchedule(time(NULL) + PancakeHTTPConfiguration.requestTimeout, (PancakeSchedulerEventCallback) PancakeHTTPOnClientTimeout, sock);
+	} else if(!sock->deadline) {
+		PancakeNetworkSetTimeout(sock, PancakeHTTPConfiguration.requestTimeout * 1000, PancakeHTTPOnClientTimeout);
 	}
 }
 
@@ -1378,9 +1393,8 @@ PANCAKE_API void PancakeHTTPException(PancakeSocket *sock, UInt16 code) {
 		return;
 	}
 
-	// Reallocate buffer to correct size
-	sock->writeBuffer.size = sock->writeBuffer.length + request->contentLength;
-	sock->writeBuffer.value = PancakeReallocate(sock->writeBuffer.value, sock->writeBuffer.size);
+	// Make room for exception page
+	PancakeNetworkBufferReserve(&sock->writeBuffer, sock->writeBuffer.length + request->contentLength);
 
 	// Build exception page
 	offset = sock->writeBuffer.value + sock->writeBuffer.length;
@@ -1448,21 +1462,12 @@ PANCAKE_API extern inline void PancakeHTTPOnRemoteHangup(PancakeSocket *sock) {
 	if(request != NULL) {
 		PancakeHTTPCleanRequestData(request);
 
-		if(request->schedulerEvent) {
-			PancakeUnschedule(request->schedulerEvent);
-		}
-
-		PancakeFree(sock->data);
+		PancakePoolFree(&PancakeHTTPRequestPool, sock->data);
 	}
 
 	PancakeNetworkClose(sock);
 }
 
-STATIC void PancakeHTTPOnKeepAliveRemoteHangup(PancakeSocket *sock) {
-	PancakeUnschedule((PancakeSchedulerEvent*) sock->data);
-	PancakeNetworkClose(sock);
-}
-
 PANCAKE_API extern inline void PancakeHTTPFullWriteBuffer(PancakeSocket *sock) {
 	PancakeNetworkWrite(sock);
 
@@ -1574,10 +1579,7 @@ PANCAKE_API void PancakeHTTPOutput(PancakeSocket *sock, String *output) {
 	}
 
 	// Resize buffer
-	if(sock->writeBuffer.size < sock->writeBuffer.length + output->length) {
-		sock->writeBuffer.size += output->length + 2048;
-		sock->writeBuffer.value = PancakeReallocate(sock->writeBuffer.value, sock->writeBuffer.size);
-	}
+	PancakeNetworkBufferReserve(&sock->writeBuffer, sock->writeBuffer.length + output->length);
 
 	// Copy to buffer
 	memcpy(sock->writeBuffer.value + sock->writeBuffer.length, output->value, output->length);
@@ -1611,10 +1613,7 @@ PANCAKE_API void PancakeHTTPSendChunk(PancakeSocket *sock, String *chunk) {
 	if(request->HTTPVersion == PANCAKE_HTTP_10) {
 		PancakeAssert(request->headerSent == 0);
 
-		if(sock->writeBuffer.size < sock->writeBuffer.length + chunk->length) {
-			sock->writeBuffer.size = sock->writeBuffer.length + chunk->length;
-			sock->writeBuffer.value = PancakeReallocate(sock->writeBuffer.value, sock->writeBuffer.size);
-		}
+		PancakeNetworkBufferReserve(&sock->writeBuffer, sock->writeBuffer.length + chunk->length);
 
 		memcpy(sock->writeBuffer.value + sock->writeBuffer.length, chunk->value, chunk->length);
 		sock->writeBuffer.length += chunk->length;
@@ -1627,10 +1626,7 @@ PANCAKE_API void PancakeHTTPSendChunk(PancakeSocket *sock, String *chunk) {
 	}
 
 	// Reallocate buffer if necessary
-	if(sock->writeBuffer.size < sock->writeBuffer.length + chunk->length + sizeof("ffffffff\r\n\r\n") - 1) {
-		sock->writeBuffer.size = sock->writeBuffer.length + chunk->length + sizeof("ffffffff\r\n\r\n") - 1;
-		sock->writeBuffer.value = PancakeReallocate(sock->writeBuffer.value, sock->writeBuffer.size);
-	}
+	PancakeNetworkBufferReserve(&sock->writeBuffer, sock->writeBuffer.length + chunk->length + sizeof("ffffffff\r\n\r\n") - 1);
 
 	// Write length as hex value
 	offset = sock->writeBuffer.value + sock->writeBuffer.length;
@@ -1654,10 +1650,7 @@ PANCAKE_API void PancakeHTTPSendChunk(PancakeSocket *sock, String *chunk) {
 PANCAKE_API extern inline void PancakeHTTPSendLastChunk(PancakeSocket *sock) {
 	UByte *offset;
 
-	if(sock->writeBuffer.size < sock->writeBuffer.length + sizeof("0\r\n\r\n") - 1) {
-		sock->writeBuffer.size += sizeof("0\r\n\r\n") - 1;
-		sock->writeBuffer.value = PancakeReallocate(sock->writeBuffer.value, sock->writeBuffer.size);
-	}
+	PancakeNetworkBufferReserve(&sock->writeBuffer, sock->writeBuffer.length + sizeof("0\r\n\r\n") - 1);
 
 	offset = sock->writeBuffer.value + sock->writeBuffer.length;
 	offset[0] = '0';
@@ -1680,8 +1673,7 @@ PANCAKE_API void PancakeHTTPBuildAnswerHeaders(PancakeSocket *sock) {
 	// Set headerSent flag
 	request->headerSent = 1;
 
-	sock->writeBuffer.size += headerSize;
-	sock->writeBuffer.value = PancakeReallocate(sock->writeBuffer.value, sock->writeBuffer.size);
+	PancakeNetworkBufferReserve(&sock->writeBuffer, sock->writeBuffer.length + headerSize);
 
 	if(request->HTTPVersion == PANCAKE_HTTP_10 && request->chunkedTransfer == 1) {
 		// Chunks from content backend complete, make HTTP1.0-compatible transfer
@@ -1706,6 +1698,14 @@ PANCAKE_API void PancakeHTTPBuildAnswerHeaders(PancakeSocket *sock) {
 
 	// Answer code
 	PancakeAssert(request->answerCode >= 100 && request->answerCode <= 599);
+
+	// Every answer is counted here exactly once
+	if(EXPECTED(request->method)) {
+		PancakeStatisticsIncrement(requests[request->method - 1]);
+	}
+
+	PancakeStatisticsIncrement(answers[request->answerCode / 100 - 1]);
+
 	itoa(request->answerCode, &sock->writeBuffer.value[9], 10);
 
 	// Answer code string
@@ -1818,9 +1818,14 @@ PANCAKE_API void PancakeHTTPBuildAnswerHeaders(PancakeSocket *sock) {
 		PancakeHTTPHeader *header = NULL, *tmp;
 
 		LL_FOREACH_SAFE(request->answerHeaders, header, tmp) {
-			if((offset - sock->writeBuffer.value + header->name.length + header->value.length + 2) > headerSize) {
-				sock->writeBuffer.size += 1024;
-				sock->writeBuffer.value = PancakeReallocate(sock->writeBuffer.value, sock->writeBuffer.size);
+			// Leave room for ": ", "\r\n" and the final "\r\n"
+			while((offset - sock->writeBuffer.value + header->name.length + header->value.length + 6) > headerSize) {
+				UInt32 position = offset - sock->writeBuffer.value;
+
+				// Let the buffer keep the headers written so far and the aligned output
+				sock->writeBuffer.length = alignOutput ? headerSize + request->contentLength : position;
+				PancakeNetworkBufferReserve(&sock->writeBuffer, headerSize + 1024 + (alignOutput ? request->contentLength : 0));
+				offset = sock->writeBuffer.value + position;
 
 				if(alignOutput) {
 					memmove(sock->writeBuffer.value + headerSize + 1024, sock->writeBuffer.value + headerSize, request->contentLength);
@@ -1845,7 +1850,7 @@ PANCAKE_API void PancakeHTTPBuildAnswerHeaders(PancakeSocket *sock) {
 			// Free header instance
 			PancakeFree(header->name.value);
 			PancakeFree(header->value.value);
-			PancakeFree(header);
+			PancakePoolFree(&PancakeHTTPHeaderPool, header);
 		}
 	}
 
@@ -1988,17 +1993,19 @@ PANCAKE_API extern inline void PancakeHTTPOnRequestEnd(PancakeSocket *sock) {
 
 		PancakeHTTPCleanRequestData(request);
 
-		PancakeFree(sock->data);
+		PancakePoolFree(&PancakeHTTPRequestPool, sock->data);
 
-		// Schedule keep-alive timeout event
-		sock->data = (void*) PancakeSchedule(time(NULL) + PancakeHTTPConfiguration.keepAliveTimeout, (PancakeSchedulerEventCallback) PancakeNetworkClose, sock);
+		sock->data = NULL;
 
-		// Destroy write buffer
-		if(sock->writeBuffer.size) {
-			sock->writeBuffer.size = 0;
-			PancakeFree(sock->writeBuffer.value);
-			sock->writeBuffer.value = NULL;
-		}
+		// Pending timeout events of this connection are reused
+		PancakeNetworkSetTimeout(sock, PancakeHTTPConfiguration.keepAliveTimeout * 1000, PancakeNetworkClose);
+
+		// Worker doesn't wait for idle connections while shutting down
+		PancakeNetworkSetIdle(sock, 1);
+
+		// Return buffers to pool while the connection is idle
+		PancakeNetworkBufferRelease(&sock->writeBuffer);
+		PancakeNetworkBufferRelease(&sock->readBuffer);
 
 		// Reset HTTP exception flag
 		if(sock->flags & PANCAKE_HTTP_EXCEPTION) {
@@ -2010,10 +2017,8 @@ PANCAKE_API extern inline void PancakeHTTPOnRequestEnd(PancakeSocket *sock) {
 			sock->flags ^= PANCAKE_HTTP_HEADER_DATA_COMPLETE;
 		}
 
-		sock->readBuffer.length = 0;
-
 		sock->onRead = PancakeHTTPInitializeKeepAliveConnection;
-		sock->onRemoteHangup = PancakeHTTPOnKeepAliveRemoteHangup;
+		sock->onRemoteHangup = PancakeNetworkClose;
 	} else {
 		PancakeHTTPOnRemoteHangup(sock);
 	}
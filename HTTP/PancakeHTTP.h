@@ -7,6 +7,7 @@
 #include "../PancakeNetwork.h"
 #include "../MIME/PancakeMIME.h"
 #include "../PancakeScheduler.h"
+#include "../PancakePool.h"
 
 /* Forward declarations */
 typedef struct _PancakeHTTPHeader PancakeHTTPHeader;
@@ -103,7 +104,6 @@ typedef struct _PancakeHTTPRequest {
 	PancakeHTTPEventHandler onRequestEnd;
 	PancakeHTTPEventHandler onOutputEnd;
 	PancakeSocket *socket;
-	PancakeSchedulerEvent *schedulerEvent;
 
 	UByte method;
 	UByte HTTPVersion;
@@ -145,9 +145,12 @@ extern PancakeHTTPConfigurationStructure PancakeHTTPConfiguration;
 extern String PancakeHTTPAnswerCodes[];
 extern const String PancakeHTTPMethods[];
 extern UInt16 PancakeHTTPNumVirtualHosts;
+extern PancakePool PancakeHTTPRequestPool;
+extern PancakePool PancakeHTTPHeaderPool;
 
 UByte PancakeHTTPInitialize();
 UByte PancakeHTTPCheckConfiguration();
+UByte PancakeHTTPShutdown();
 void PancakeHTTPSRegisterProtocol();
 
 PANCAKE_API void PancakeHTTPRegisterContentServeBackend(PancakeHTTPContentServeBackend *backend);
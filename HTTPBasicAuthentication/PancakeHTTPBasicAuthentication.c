@@ -92,7 +92,7 @@ STATIC UByte PancakeHTTPBasicAuthenticate(PancakeSocket *sock) {
 		}
 
 		// Build WWW-Authenticate header
-		header = PancakeAllocate(sizeof(PancakeHTTPHeader));
+		header = PancakePoolAllocate(&PancakeHTTPHeaderPool);
 		header->name.value = PancakeAllocate(sizeof("WWW-Authenticate") - 1);
 		header->name.length = sizeof("WWW-Authenticate") - 1;
 		memcpy(header->name.value, "WWW-Authenticate", sizeof("WWW-Authenticate") - 1);
@@ -1,6 +1,7 @@
 
 #include "PancakeHTTPFastCGI.h"
 #include "../PancakeLogger.h"
+#include "../PancakeStatistics.h"
 
 #ifdef PANCAKE_HTTPREWRITE
 #include "../HTTPRewrite/PancakeHTTPRewrite.h"
@@ -46,9 +47,12 @@ STATIC UByte PancakeHTTPFastCGIConfiguration(UByte step, config_setting_t *setti
 		setting->hook = PancakeAllocate(sizeof(PancakeFastCGIClient));
 		client = (PancakeFastCGIClient*) setting->hook;
 		client->multiplex = -1;
-		client->connectionCache = NULL;
+		PancakeNetworkInitializeConnectionCache(&client->connectionCache);
+		client->connectionCache.maxIdle = PANCAKE_FASTCGI_MAX_IDLE_CONNECTIONS;
+		client->connectionCache.idleTimeout = PANCAKE_FASTCGI_IDLE_TIMEOUT;
 		client->highestRequestID = 0;
 		client->keepAlive = 0;
+		client->connectTimeout = PANCAKE_FASTCGI_CONNECT_TIMEOUT;
 
 		memset(&client->requests, 0, PANCAKE_FASTCGI_MAX_REQUEST_ID);
 		memset(&client->sockets, 0, PANCAKE_FASTCGI_MAX_REQUEST_ID);
@@ -59,6 +63,8 @@ STATIC UByte PancakeHTTPFastCGIConfiguration(UByte step, config_setting_t *setti
 
 		PancakeDebug {
 			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Highest request ID used with FastCGI client %s: %i", client->name.value, client->highestRequestID);
+			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "FastCGI client %s connection cache: %lu hits, %lu misses", client->name.value,
+					(unsigned long) client->connectionCache.hits, (unsigned long) client->connectionCache.misses);
 		}
 
 		PancakeFree(client);
@@ -140,6 +146,66 @@ STATIC UByte PancakeHTTPFastCGIKeepAliveConfiguration(UByte step, config_setting
 	return 1;
 }
 
+STATIC UByte PancakeHTTPFastCGIConnectTimeoutConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	PancakeFastCGIClient *client = (PancakeFastCGIClient*) setting->parent->hook;
+
+	if(step == PANCAKE_CONFIGURATION_INIT) {
+		if(setting->value.ival < 0) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "FastCGI ConnectTimeout must not be negative");
+			return 0;
+		}
+
+		client->connectTimeout = setting->value.ival;
+	}
+
+	return 1;
+}
+
+STATIC UByte PancakeHTTPFastCGIMaxIdleConnectionsConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	PancakeFastCGIClient *client = (PancakeFastCGIClient*) setting->parent->hook;
+
+	if(step == PANCAKE_CONFIGURATION_INIT) {
+		if(setting->value.ival < 0) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "FastCGI MaxIdleConnections must not be negative");
+			return 0;
+		}
+
+		client->connectionCache.maxIdle = setting->value.ival;
+	}
+
+	return 1;
+}
+
+STATIC UByte PancakeHTTPFastCGIMaxConnectionsConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	PancakeFastCGIClient *client = (PancakeFastCGIClient*) setting->parent->hook;
+
+	if(step == PANCAKE_CONFIGURATION_INIT) {
+		if(setting->value.ival < 0) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "FastCGI MaxConnections must not be negative");
+			return 0;
+		}
+
+		client->connectionCache.maxTotal = setting->value.ival;
+	}
+
+	return 1;
+}
+
+STATIC UByte PancakeHTTPFastCGIIdleTimeoutConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	PancakeFastCGIClient *client = (PancakeFastCGIClient*) setting->parent->hook;
+
+	if(step == PANCAKE_CONFIGURATION_INIT) {
+		if(setting->value.ival < 0) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "FastCGI IdleTimeout must not be negative");
+			return 0;
+		}
+
+		client->connectionCache.idleTimeout = setting->value.ival;
+	}
+
+	return 1;
+}
+
 STATIC UByte PancakeHTTPFastCGIInitialize() {
 	PancakeConfigurationSetting *FastCGIClients, *FastCGIClient, *VirtualHosts;
 	PancakeConfigurationGroup *FastCGIGroup, *HTTP;
@@ -163,6 +229,10 @@ STATIC UByte PancakeHTTPFastCGIInitialize() {
 	FastCGIGroup = PancakeConfigurationListGroup(FastCGIClients, PancakeHTTPFastCGIConfiguration);
 	PancakeConfigurationAddSetting(FastCGIGroup, (String) {"Name", sizeof("Name") - 1}, CONFIG_TYPE_STRING, NULL, 0, (config_value_t) 0, PancakeHTTPFastCGINameConfiguration);
 	PancakeConfigurationAddSetting(FastCGIGroup, (String) {"KeepAlive", sizeof("KeepAlive") - 1}, CONFIG_TYPE_BOOL, NULL, 0, (config_value_t) 0, PancakeHTTPFastCGIKeepAliveConfiguration);
+	PancakeConfigurationAddSetting(FastCGIGroup, StaticString("ConnectTimeout"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) PANCAKE_FASTCGI_CONNECT_TIMEOUT, PancakeHTTPFastCGIConnectTimeoutConfiguration);
+	PancakeConfigurationAddSetting(FastCGIGroup, StaticString("MaxIdleConnections"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) PANCAKE_FASTCGI_MAX_IDLE_CONNECTIONS, PancakeHTTPFastCGIMaxIdleConnectionsConfiguration);
+	PancakeConfigurationAddSetting(FastCGIGroup, StaticString("MaxConnections"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeHTTPFastCGIMaxConnectionsConfiguration);
+	PancakeConfigurationAddSetting(FastCGIGroup, StaticString("IdleTimeout"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) PANCAKE_FASTCGI_IDLE_TIMEOUT, PancakeHTTPFastCGIIdleTimeoutConfiguration);
 	PancakeNetworkRegisterClientInterfaceGroup(FastCGIGroup, PancakeHTTPFastCGIClientInterfaceConfiguration);
 
 	HTTP = PancakeConfigurationLookupGroup(NULL, (String) {"HTTP", 4});
@@ -198,10 +268,7 @@ STATIC void PancakeHTTPFastCGIWriteContentBody(PancakeSocket *socket, PancakeSoc
 		return;
 	}
 
-	if(socket->writeBuffer.size < socket->writeBuffer.length + 16 + length) {
-		socket->writeBuffer.size = socket->writeBuffer.length + 16 + length;
-		socket->writeBuffer.value = PancakeReallocate(socket->writeBuffer.value, socket->writeBuffer.size);
-	}
+	PancakeNetworkBufferReserve(&socket->writeBuffer, socket->writeBuffer.length + 16 + length);
 
 	offset = socket->writeBuffer.value + socket->writeBuffer.length;
 	request->clientContentLength -= length;
@@ -267,10 +334,7 @@ STATIC inline void FastCGIEncodeParameter(PancakeSocket *sock, String *name, Str
 	UInt32 length = name->length + value->length + (name->length < 128 ? 1 : 4) + (value->length < 128 ? 1 : 4);
 
 	// Resize buffer if required
-	if(sock->writeBuffer.size < sock->writeBuffer.length + length) {
-		sock->writeBuffer.size = sock->writeBuffer.length + length + 96;
-		sock->writeBuffer.value = PancakeReallocate(sock->writeBuffer.value, sock->writeBuffer.size);
-	}
+	PancakeNetworkBufferReserve(&sock->writeBuffer, sock->writeBuffer.length + length);
 
 	// Get offset to free space in buffer
 	offset = sock->writeBuffer.value + sock->writeBuffer.length;
@@ -515,7 +579,7 @@ STATIC void FastCGIReadRecord(PancakeSocket *sock) {
 									goto StoreHeader;
 								default:
 								StoreHeader: {
-									PancakeHTTPHeader *header = PancakeAllocate(sizeof(PancakeHTTPHeader));
+									PancakeHTTPHeader *header = PancakePoolAllocate(&PancakeHTTPHeaderPool);
 
 									header->name.length = ptr - start;
 									header->name.value = PancakeAllocate(header->name.length);
@@ -571,14 +635,12 @@ STATIC void FastCGIReadRecord(PancakeSocket *sock) {
 
 			// Cache FCGI connection
 			if(client->keepAlive) {
-				if(UNEXPECTED(sock->flags & PANCAKE_FASTCGI_UNCACHED_CONNECTION)) {
-					if(client->multiplex != -1) {
-						sock->flags ^= PANCAKE_FASTCGI_UNCACHED_CONNECTION;
-					}
-					PancakeNetworkCacheConnection(&client->connectionCache, sock);
-				} else if(!client->multiplex) {
-					PancakeNetworkCacheConnection(&client->connectionCache, sock);
+				if(UNEXPECTED(sock->flags & PANCAKE_FASTCGI_UNCACHED_CONNECTION) && client->multiplex != -1) {
+					sock->flags ^= PANCAKE_FASTCGI_UNCACHED_CONNECTION;
 				}
+
+				// Multiplexed connections are released by each of their requests
+				PancakeNetworkCacheConnection(&client->connectionCache, sock);
 			}
 
 			// Check whether client hung up
@@ -640,6 +702,26 @@ STATIC void PancakeHTTPFastCGIOnWrite(PancakeSocket *sock) {
 	}
 }
 
+STATIC void PancakeHTTPFastCGIOnConnect(PancakeSocket *sock, Int32 error) {
+	if(error) {
+		PancakeFastCGIClient *client = (PancakeFastCGIClient*) sock->data;
+
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't connect to FastCGI client %s: %s", client->name.value, strerror(error));
+
+		// Fail all requests waiting on this connection
+		PancakeHTTPFastCGIOnRemoteHangup(sock);
+		return;
+	}
+
+	// Send buffered records
+	PancakeHTTPFastCGIOnWrite(sock);
+
+	// Add write socket if necessary
+	if(sock->writeBuffer.length) {
+		PancakeNetworkAddWriteSocket(sock);
+	}
+}
+
 STATIC void PancakeHTTPFastCGIOnRemoteHangup(PancakeSocket *sock) {
 	// Lookup running requests on socket
 	UInt16 i;
@@ -656,6 +738,7 @@ STATIC void PancakeHTTPFastCGIOnRemoteHangup(PancakeSocket *sock) {
 			} else if(!client->requests[i]->headerSent) {
 				// Send exception if no data was sent yet
 				client->requests[i]->chunkedTransfer = 0;
+				PancakeStatisticsIncrement(upstreamErrors);
 				PancakeHTTPException(client->requests[i]->socket, 502);
 			} else {
 				// End request if data was already sent
@@ -735,10 +818,7 @@ STATIC void PancakeHTTPFastCGIOnClientHangup(PancakeSocket *sock) {
 	FCGIAbortRequest[3] = (UByte) requestID;
 
 	// Resize buffer if necessary
-	if(FCGISocket->writeBuffer.size < FCGISocket->writeBuffer.length + sizeof(FCGIAbortRequest)) {
-		FCGISocket->writeBuffer.size += sizeof(FCGIAbortRequest);
-		FCGISocket->writeBuffer.value = PancakeReallocate(FCGISocket->writeBuffer.value, FCGISocket->writeBuffer.size);
-	}
+	PancakeNetworkBufferReserve(&FCGISocket->writeBuffer, FCGISocket->writeBuffer.length + sizeof(FCGIAbortRequest));
 
 	// Copy record to buffer
 	memcpy(FCGISocket->writeBuffer.value + FCGISocket->writeBuffer.length, FCGIAbortRequest, sizeof(FCGIAbortRequest));
@@ -779,10 +859,11 @@ STATIC UByte PancakeHTTPFastCGIServe(PancakeSocket *clientSocket) {
 		// Get server capabilities if unknown
         if(UNEXPECTED(FastCGIConfiguration.client->keepAlive && FastCGIConfiguration.client->multiplex == -1)) {
 			// Server capabilities unknown, let's ask
-			PancakeSocket *vsocket = PancakeNetworkConnect(FastCGIConfiguration.client->address, NULL, 0);
+			PancakeSocket *vsocket = PancakeNetworkConnect((PancakeNetworkClientInterface*) FastCGIConfiguration.client, NULL, 0);
 
 			if(vsocket == NULL) {
 					// Connection failed
+					PancakeStatisticsIncrement(upstreamErrors);
 					PancakeHTTPException(clientSocket, 503);
 					return 0;
 			}
@@ -792,18 +873,14 @@ STATIC UByte PancakeHTTPFastCGIServe(PancakeSocket *clientSocket) {
 			vsocket->onRemoteHangup = PancakeHTTPFastCGIOnRemoteHangup;
 			vsocket->data = (void*) FastCGIConfiguration.client;
 
-			vsocket->writeBuffer.length = vsocket->writeBuffer.size = sizeof("\x1\x9\0\0\0\x11\0\0" "\xf\0" "FCGI_MPXS_CONNS") - 1;
-			vsocket->writeBuffer.value = PancakeAllocate(vsocket->writeBuffer.size);
+			vsocket->writeBuffer.length = sizeof("\x1\x9\0\0\0\x11\0\0" "\xf\0" "FCGI_MPXS_CONNS") - 1;
+			PancakeNetworkBufferReserve(&vsocket->writeBuffer, vsocket->writeBuffer.length);
 
 			// FCGI_GET_VALUES
 			memcpy(vsocket->writeBuffer.value, "\x1\x9\0\0\0\x11\0\0" "\xf\0" "FCGI_MPXS_CONNS", sizeof("\x1\x9\0\0\0\x11\0\0" "\xf\0" "FCGI_MPXS_CONNS") - 1);
 
-			PancakeHTTPFastCGIOnWrite(vsocket);
-
-			// Add write socket if necessary
-			if(vsocket->writeBuffer.length) {
-				PancakeNetworkAddWriteSocket(vsocket);
-			}
+			// Send as soon as the connection is established
+			PancakeNetworkOnConnect(vsocket, FastCGIConfiguration.client->connectTimeout * 1000, PancakeHTTPFastCGIOnConnect);
         }
 
 		// Lookup first free request ID
@@ -820,10 +897,11 @@ STATIC UByte PancakeHTTPFastCGIServe(PancakeSocket *clientSocket) {
 			return 0;
 		}
 
-		socket = PancakeNetworkConnect(FastCGIConfiguration.client->address, &FastCGIConfiguration.client->connectionCache, FastCGIConfiguration.client->multiplex == 1 ? PANCAKE_NETWORK_CONNECTION_CACHE_KEEP : PANCAKE_NETWORK_CONNECTION_CACHE_REMOVE);
+		socket = PancakeNetworkConnect((PancakeNetworkClientInterface*) FastCGIConfiguration.client, &FastCGIConfiguration.client->connectionCache, FastCGIConfiguration.client->multiplex == 1 ? PANCAKE_NETWORK_CONNECTION_CACHE_KEEP : PANCAKE_NETWORK_CONNECTION_CACHE_REMOVE);
 
 		if(socket == NULL) {
 			// Connection failed
+			PancakeStatisticsIncrement(upstreamErrors);
 			PancakeHTTPException(clientSocket, 503);
 			return 0;
 		}
@@ -833,9 +911,8 @@ STATIC UByte PancakeHTTPFastCGIServe(PancakeSocket *clientSocket) {
 			socket->flags |= PANCAKE_FASTCGI_UNCACHED_CONNECTION;
 		}
 
-		socket->onRead = PancakeHTTPFastCGIOnRead;
-		socket->onWrite = PancakeHTTPFastCGIOnWrite;
-		socket->onRemoteHangup = PancakeHTTPFastCGIOnRemoteHangup;
+		// Multiplexed connections may still be connecting for another request
+		PancakeNetworkSetHandlers(socket, PancakeHTTPFastCGIOnRead, PancakeHTTPFastCGIOnWrite, PancakeHTTPFastCGIOnRemoteHangup);
 		socket->data = (void*) FastCGIConfiguration.client;
 
 		// Set FCGI client hangup handler
@@ -854,10 +931,7 @@ STATIC UByte PancakeHTTPFastCGIServe(PancakeSocket *clientSocket) {
 		request->contentServeData = (void*) (UNative) requestID;
 
 		// Resize buffer
-		if(socket->writeBuffer.size < socket->writeBuffer.length + 512) {
-			socket->writeBuffer.size = socket->writeBuffer.length + 512;
-			socket->writeBuffer.value = PancakeReallocate(socket->writeBuffer.value, socket->writeBuffer.size);
-		}
+		PancakeNetworkBufferReserve(&socket->writeBuffer, socket->writeBuffer.length + 512);
 
 		// FCGI_BEGIN_REQUEST
 		// Version 1; Type 1; RequestID (2 bytes); ContentLength 8 (2 bytes); PaddingLength 0 (2 bytes); Reserved; Role 1 (2 bytes); Flag FCGI_KEEP_CONN; Reserved (5 bytes)
@@ -1012,10 +1086,7 @@ STATIC UByte PancakeHTTPFastCGIServe(PancakeSocket *clientSocket) {
 		socket->writeBuffer.value[offset + 7] = '\0'; // Reserved
 
 		// Resize buffer for another FCGIParams record if required
-		if(socket->writeBuffer.size < socket->writeBuffer.length + 8) {
-			socket->writeBuffer.size = socket->writeBuffer.length + 32;
-			socket->writeBuffer.value = PancakeReallocate(socket->writeBuffer.value, socket->writeBuffer.size);
-		}
+		PancakeNetworkBufferReserve(&socket->writeBuffer, socket->writeBuffer.length + 8);
 
 		// Another empty FCGIParams
 #if PANCAKE_FASTCGI_MAX_REQUEST_ID > 255
@@ -1025,13 +1096,8 @@ STATIC UByte PancakeHTTPFastCGIServe(PancakeSocket *clientSocket) {
 		memcpy(socket->writeBuffer.value + socket->writeBuffer.length, FCGIParams, 8);
 		socket->writeBuffer.length += 8;
 
-		// Try to write now
-		PancakeHTTPFastCGIOnWrite(socket);
-
-		// Add socket to server architecture if necessary
-		if(socket->writeBuffer.length) {
-			PancakeNetworkAddWriteSocket(socket);
-		}
+		// Try to write now or as soon as the connection is established
+		PancakeNetworkOnConnect(socket, FastCGIConfiguration.client->connectTimeout * 1000, PancakeHTTPFastCGIOnConnect);
 
 		// Write STDIN
 		if(request->headerEnd < clientSocket->readBuffer.length - 4) {
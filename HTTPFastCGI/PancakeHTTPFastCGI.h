@@ -8,13 +8,17 @@
 
 #define PANCAKE_FASTCGI_MAX_REQUEST_ID 1024
 #define PANCAKE_FASTCGI_SERVER_SOFTWARE "Pancake/" PANCAKE_VERSION
+#define PANCAKE_FASTCGI_CONNECT_TIMEOUT 5
+#define PANCAKE_FASTCGI_MAX_IDLE_CONNECTIONS 16
+#define PANCAKE_FASTCGI_IDLE_TIMEOUT 60
 
 typedef struct _PancakeFastCGIClient {
-	// MUST be the first element (struct will be casted to PancakeNetworkClientInterface)
+	// MUST be the first elements (struct will be casted to PancakeNetworkClientInterface)
 	struct sockaddr *address;
+	PancakeNetworkSocketOptions socketOptions;
 
 	String name;
-	PancakeNetworkConnectionCache *connectionCache;
+	PancakeNetworkConnectionCache connectionCache;
 
 	PancakeHTTPRequest *requests[PANCAKE_FASTCGI_MAX_REQUEST_ID];
 	PancakeSocket *sockets[PANCAKE_FASTCGI_MAX_REQUEST_ID];
@@ -22,6 +26,7 @@ typedef struct _PancakeFastCGIClient {
 	Byte multiplex;
 	Byte keepAlive;
 	UInt16 highestRequestID;
+	UInt32 connectTimeout;
 
 	UT_hash_handle hh;
 } PancakeFastCGIClient;
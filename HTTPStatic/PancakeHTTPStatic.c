@@ -2,6 +2,7 @@
 #include "PancakeHTTPStatic.h"
 #include "../MIME/PancakeMIME.h"
 #include "../PancakeDateTime.h"
+#include "../PancakeStatistics.h"
 
 /* Forward declarations */
 STATIC UByte PancakeHTTPServeStatic(PancakeSocket *sock);
@@ -34,23 +35,103 @@ STATIC UByte PancakeHTTPStaticInitialize() {
 }
 
 STATIC inline void PancakeHTTPStaticOnRequestEnd(PancakeHTTPRequest *request) {
-	fclose(request->contentServeData);
+	PancakeHTTPStaticFile *file = (PancakeHTTPStaticFile*) request->contentServeData;
+
+	close(file->fd);
+	PancakeFree(file);
 }
 
+#ifdef HAVE_SYS_SENDFILE_H
+STATIC void PancakeHTTPStaticSendFile(PancakeSocket *sock) {
+	PancakeHTTPRequest *request = (PancakeHTTPRequest*) sock->data;
+	PancakeHTTPStaticFile *file = (PancakeHTTPStaticFile*) request->contentServeData;
+	size_t count;
+	ssize_t length;
+
+	// Send buffered data (answer headers) first
+	if(sock->writeBuffer.length) {
+		if(PancakeNetworkWrite(sock) == -1 || sock->writeBuffer.length) {
+			return;
+		}
+	}
+
+	// Let the kernel copy file contents directly to the socket
+	count = file->remaining > PancakeMainConfiguration.networkBufferingMax ? PancakeMainConfiguration.networkBufferingMax : file->remaining;
+	length = sendfile(sock->fd, file->fd, NULL, count);
+
+	if(length == -1) {
+#if EAGAIN != EWOULDBLOCK // On some systems these values differ
+		if(errno == EAGAIN || errno == EWOULDBLOCK)
+#else
+		if(errno == EAGAIN)
+#endif
+		{
+			sock->flags &= ~(PANCAKE_NETWORK_WRITABLE);
+			return;
+		}
+
+		PancakeHTTPOnRemoteHangup(sock);
+		return;
+	}
+
+	// File was truncated while serving it, we can't deliver the announced length
+	if(UNEXPECTED(length == 0)) {
+		PancakeHTTPOnRemoteHangup(sock);
+		return;
+	}
+
+	// Bypasses PancakeNetworkWrite, count it here
+	PancakeStatisticsAdd(bytesOut, length);
+
+	file->remaining -= length;
+
+	if(!file->remaining) {
+		PancakeHTTPOnRequestEnd(sock);
+		return;
+	}
+
+	// Socket buffer is full after a short write
+	if(length < count) {
+		sock->flags &= ~(PANCAKE_NETWORK_WRITABLE);
+	}
+}
+#endif
+
 STATIC void PancakeHTTPStaticWrite(PancakeSocket *sock) {
 	PancakeHTTPRequest *request = (PancakeHTTPRequest*) sock->data;
+	PancakeHTTPStaticFile *file = (PancakeHTTPStaticFile*) request->contentServeData;
+	UInt32 pending = sock->writeBuffer.length - sock->writeBuffer.offset;
 
-	if(sock->writeBuffer.length < PancakeMainConfiguration.networkBufferingMin) {
-		UByte buf[PancakeMainConfiguration.networkBufferingMax - sock->writeBuffer.length];
+	if(pending < PancakeMainConfiguration.networkBufferingMin && file->remaining) {
+		UByte buf[PancakeMainConfiguration.networkBufferingMax - pending];
 		String output;
+		ssize_t length;
+
+		length = read(file->fd, buf, PancakeMainConfiguration.networkBufferingMax - pending);
+
+		if(UNEXPECTED(length <= 0)) {
+			// File was truncated or can't be read anymore
+			PancakeHTTPOnRemoteHangup(sock);
+			return;
+		}
 
 		output.value = buf;
-		output.length = fread(buf, 1, PancakeMainConfiguration.networkBufferingMax - sock->writeBuffer.length, request->contentServeData);
+		output.length = length;
+		file->remaining -= length;
 
 		PancakeHTTPOutput(sock, &output);
+
+#ifdef HAVE_SYS_SENDFILE_H
+		// No output filter claimed the response, send remaining data without copying
+		if(file->remaining && !sock->layer && !request->outputFilter) {
+			sock->onWrite = PancakeHTTPStaticSendFile;
+			PancakeHTTPStaticSendFile(sock);
+			return;
+		}
+#endif
 	}
 
-	if(feof((FILE*) request->contentServeData)) {
+	if(!file->remaining) {
 		if(sock->writeBuffer.length) {
 			sock->onWrite = PancakeHTTPFullWriteBuffer;
 			PancakeHTTPFullWriteBuffer(sock);
@@ -111,17 +192,38 @@ STATIC UByte PancakeHTTPServeStatic(PancakeSocket *sock) {
 			sock->onWrite = PancakeHTTPFullWriteBuffer;
 			PancakeHTTPFullWriteBuffer(sock);
 		} else {
+			PancakeHTTPStaticFile *file;
+			Int32 fd;
+
 			// Open file
-			request->contentServeData = (void*) fopen(fullPath, "r");
+			fd = open(fullPath, O_RDONLY);
 
-			if(request->contentServeData == NULL) {
+			if(fd == -1) {
 				PancakeHTTPException(sock, 403);
 				return 0;
 			}
 
-			sock->onWrite = PancakeHTTPStaticWrite;
+			file = PancakeAllocate(sizeof(PancakeHTTPStaticFile));
+			file->fd = fd;
+			file->remaining = request->contentLength;
+
+			request->contentServeData = (void*) file;
 			request->onRequestEnd = PancakeHTTPStaticOnRequestEnd;
 
+#ifdef HAVE_SYS_SENDFILE_H
+			// Output filters and network layers need the file contents in user space
+			if(!sock->layer && !request->vHost->numOutputFilters) {
+				PancakeHTTPBuildAnswerHeaders(sock);
+				sock->onWrite = PancakeHTTPStaticSendFile;
+
+				// Try to write now
+				PancakeHTTPStaticSendFile(sock);
+				return 1;
+			}
+#endif
+
+			sock->onWrite = PancakeHTTPStaticWrite;
+
 			// Try to write now
 			PancakeHTTPStaticWrite(sock);
 		}
@@ -6,6 +6,15 @@
 
 #include "../HTTP/PancakeHTTP.h"
 
+#ifdef HAVE_SYS_SENDFILE_H
+#	include <sys/sendfile.h>
+#endif
+
+typedef struct _PancakeHTTPStaticFile {
+	Int32 fd;
+	off_t remaining;
+} PancakeHTTPStaticFile;
+
 extern PancakeModule PancakeHTTPStatic;
 
 #endif
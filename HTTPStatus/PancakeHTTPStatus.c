@@ -0,0 +1,140 @@
+
+#include "PancakeHTTPStatus.h"
+
+/* Forward declarations */
+STATIC UByte PancakeHTTPServeStatus(PancakeSocket *sock);
+STATIC UByte PancakeHTTPStatusInitialize();
+
+PancakeModule PancakeHTTPStatus = {
+	"HTTPStatus",
+
+	PancakeHTTPStatusInitialize,
+	NULL,
+	NULL,
+
+	0
+};
+
+PancakeHTTPStatusConfigurationStructure PancakeHTTPStatusConfiguration;
+
+static PancakeHTTPContentServeBackend PancakeHTTPStatusContent = {
+	"Status",
+	PancakeHTTPServeStatus
+};
+
+static PancakeMIMEType PancakeHTTPStatusText = {
+	{"txt", sizeof("txt") - 1},
+	{"text/plain", sizeof("text/plain") - 1}
+};
+
+static PancakeMIMEType PancakeHTTPStatusJSON = {
+	{"json", sizeof("json") - 1},
+	{"application/json", sizeof("application/json") - 1}
+};
+
+STATIC UByte PancakeHTTPStatusInitialize() {
+	PancakeConfigurationGroup *HTTP, *vHostGroup, *group;
+	PancakeConfigurationSetting *vHost;
+
+	// Defer if HTTP module is not yet initialized
+	if(!PancakeHTTP.initialized) {
+		return 2;
+	}
+
+	PancakeHTTPRegisterContentServeBackend(&PancakeHTTPStatusContent);
+
+	HTTP = PancakeConfigurationLookupGroup(NULL, (String) {"HTTP", sizeof("HTTP") - 1});
+	vHost = PancakeConfigurationLookupSetting(HTTP, (String) {"VirtualHosts", sizeof("VirtualHosts") - 1});
+	vHostGroup = vHost->listGroup;
+	group = PancakeConfigurationAddGroup(HTTP, (String) {"Status", sizeof("Status") - 1}, NULL);
+	PancakeConfigurationAddSetting(group, (String) {"Path", sizeof("Path") - 1}, CONFIG_TYPE_STRING, &PancakeHTTPStatusConfiguration.path, sizeof(String*), (config_value_t) 0, PancakeConfigurationString);
+
+	// Status -> vHost configuration
+	PancakeConfigurationAddGroupToGroup(vHostGroup, group);
+
+	return 1;
+}
+
+STATIC UByte PancakeHTTPServeStatus(PancakeSocket *sock) {
+	PancakeHTTPRequest *request = (PancakeHTTPRequest*) sock->data;
+	PancakeStatistics statistics;
+	UByte *offset, json, output[1024];
+	UInt32 pathLength;
+	Int32 length;
+
+	if(PancakeHTTPStatusConfiguration.path == NULL) {
+		return 0;
+	}
+
+	// Path is left untouched for other backends when it does not match
+	offset = memchr(request->path.value, '?', request->path.length);
+	pathLength = offset ? offset - request->path.value : request->path.length;
+
+	if(pathLength != PancakeHTTPStatusConfiguration.path->length
+	|| memcmp(request->path.value, PancakeHTTPStatusConfiguration.path->value, pathLength)) {
+		return 0;
+	}
+
+	// Machine-readable output on /status?json
+	json = offset
+		&& request->path.value + request->path.length - offset - 1 == sizeof("json") - 1
+		&& !memcmp(offset + 1, "json", sizeof("json") - 1);
+
+	// Sum up the slots of all workers
+	PancakeStatisticsAggregate(&statistics);
+
+	if(json) {
+		length = snprintf((char*) output, sizeof(output),
+				"{\"acceptedConnections\":%llu,\"activeConnections\":%llu,\"keepAliveReuses\":%llu,"
+				"\"bytesIn\":%llu,\"bytesOut\":%llu,"
+				"\"requests\":{\"GET\":%llu,\"POST\":%llu,\"HEAD\":%llu},"
+				"\"answers\":{\"1xx\":%llu,\"2xx\":%llu,\"3xx\":%llu,\"4xx\":%llu,\"5xx\":%llu},"
+				"\"upstreamErrors\":%llu,\"scheduledEvents\":%llu}\n",
+				statistics.acceptedConnections, statistics.activeConnections, statistics.keepAliveReuses,
+				statistics.bytesIn, statistics.bytesOut,
+				statistics.requests[PANCAKE_HTTP_GET - 1], statistics.requests[PANCAKE_HTTP_POST - 1], statistics.requests[PANCAKE_HTTP_HEAD - 1],
+				statistics.answers[0], statistics.answers[1], statistics.answers[2], statistics.answers[3], statistics.answers[4],
+				statistics.upstreamErrors, statistics.scheduledEvents);
+	} else {
+		length = snprintf((char*) output, sizeof(output),
+				"Accepted connections: %llu\n"
+				"Active connections: %llu\n"
+				"Keep-alive reuses: %llu\n"
+				"Bytes in: %llu\n"
+				"Bytes out: %llu\n"
+				"Requests: GET %llu, POST %llu, HEAD %llu\n"
+				"Answers: 1xx %llu, 2xx %llu, 3xx %llu, 4xx %llu, 5xx %llu\n"
+				"Upstream errors: %llu\n"
+				"Scheduled events: %llu\n",
+				statistics.acceptedConnections, statistics.activeConnections, statistics.keepAliveReuses,
+				statistics.bytesIn, statistics.bytesOut,
+				statistics.requests[PANCAKE_HTTP_GET - 1], statistics.requests[PANCAKE_HTTP_POST - 1], statistics.requests[PANCAKE_HTTP_HEAD - 1],
+				statistics.answers[0], statistics.answers[1], statistics.answers[2], statistics.answers[3], statistics.answers[4],
+				statistics.upstreamErrors, statistics.scheduledEvents);
+	}
+
+	if(UNEXPECTED(length < 0 || length >= sizeof(output))) {
+		PancakeHTTPException(sock, 500);
+		return 1;
+	}
+
+	request->answerCode = 200;
+	request->contentLength = length;
+	request->answerType = json ? &PancakeHTTPStatusJSON : &PancakeHTTPStatusText;
+
+	PancakeHTTPBuildAnswerHeaders(sock);
+
+	// Statistics bypass output filters like exception pages do
+	if(request->method != PANCAKE_HTTP_HEAD) {
+		PancakeNetworkBufferReserve(&sock->writeBuffer, sock->writeBuffer.length + length);
+		memcpy(sock->writeBuffer.value + sock->writeBuffer.length, output, length);
+		sock->writeBuffer.length += length;
+	}
+
+	PancakeNetworkSetWriteSocket(sock);
+	sock->onWrite = PancakeHTTPFullWriteBuffer;
+
+	// Try to write now
+	PancakeHTTPFullWriteBuffer(sock);
+	return 1;
+}
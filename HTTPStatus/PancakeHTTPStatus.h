@@ -0,0 +1,16 @@
+
+#ifndef _PANCAKE_HTTP_STATUS_H
+#define _PANCAKE_HTTP_STATUS_H
+
+#include "../Pancake.h"
+#include "../HTTP/PancakeHTTP.h"
+#include "../PancakeStatistics.h"
+
+typedef struct _PancakeHTTPStatusConfigurationStructure {
+	String *path;
+} PancakeHTTPStatusConfigurationStructure;
+
+extern PancakeModule PancakeHTTPStatus;
+extern PancakeHTTPStatusConfigurationStructure PancakeHTTPStatusConfiguration;
+
+#endif
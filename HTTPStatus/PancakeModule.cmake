@@ -0,0 +1,8 @@
+option(PANCAKE_HTTP_STATUS "Enable Pancake HTTP server status module" OFF)
+
+if(PANCAKE_HTTP_STATUS)
+    pancake_enable_module("HTTPStatus" "PancakeHTTPStatus" "HTTPStatus/PancakeHTTPStatus.h")
+    pancake_require_module("HTTP")
+
+    set(PANCAKE_SOURCE_FILES ${PANCAKE_SOURCE_FILES} HTTPStatus/PancakeHTTPStatus.c)
+endif()
@@ -0,0 +1,1116 @@
+#include "PancakeIOUring.h"
+#include "../PancakeNetwork.h"
+#include "../PancakeConfiguration.h"
+#include "../PancakeLogger.h"
+#include "../PancakeScheduler.h"
+#include "../PancakeDateTime.h"
+
+#include <poll.h>
+#include <sys/mman.h>
+
+/* Forward declarations */
+STATIC UByte PancakeIOUringInitialize();
+STATIC UByte PancakeIOUringShutdown();
+STATIC UByte PancakeIOUringServerInitialize();
+STATIC void PancakeIOUringWait();
+STATIC void PancakeIOUringAddReadSocket(PancakeSocket *socket);
+STATIC void PancakeIOUringAddWriteSocket(PancakeSocket *socket);
+STATIC void PancakeIOUringAddReadWriteSocket(PancakeSocket *socket);
+
+STATIC void PancakeIOUringRemoveSocket(PancakeSocket *socket);
+STATIC void PancakeIOUringRemoveReadSocket(PancakeSocket *socket);
+STATIC void PancakeIOUringRemoveWriteSocket(PancakeSocket *socket);
+
+STATIC void PancakeIOUringSetReadSocket(PancakeSocket *socket);
+STATIC void PancakeIOUringSetWriteSocket(PancakeSocket *socket);
+STATIC void PancakeIOUringSetSocket(PancakeSocket *socket);
+
+STATIC void PancakeIOUringOnSocketClose(PancakeSocket *socket);
+STATIC Int32 PancakeIOUringAcceptConnection(PancakeSocket *socket, struct sockaddr *address);
+STATIC Int32 PancakeIOUringRead(PancakeSocket *socket, UByte *buffer, UInt32 length);
+STATIC Int32 PancakeIOUringWrite(PancakeSocket *socket, UByte *buffer, UInt32 length);
+
+static struct io_uring ring;
+static UByte haveRing = 0;
+static Int32 ringEntries = 4096;
+static PancakeSocket *currentSocket = NULL;
+
+/* Provided buffers the kernel receives data of stream sockets into */
+static Int32 numBuffers = 1024;
+static Int32 bufferSize = 4096;
+static struct io_uring_buf_ring *bufferRing = NULL;
+static UByte *buffers = NULL;
+
+/* Kernels before 5.19 only support single-shot accept requests */
+static UByte multishotAccept = 1;
+
+/* Submission state of sockets, indexed by file descriptor */
+static PancakeIOUringSocket **sockets = NULL;
+static UInt32 socketsSize = 0;
+
+/* Listen sockets with accept requests */
+static PancakeIOUringSocket **listenSockets = NULL;
+static UInt16 numListenSockets = 0;
+
+/* Sockets with interest changes not yet submitted */
+static PancakeSocket **changedSockets = NULL;
+static UInt32 numChangedSockets = 0;
+static UInt32 changedSocketsSize = 0;
+
+/* Sockets with received data or send results left to dispatch */
+static PancakeSocket **readySockets = NULL;
+static UInt32 numReadySockets = 0;
+static UInt32 readySocketsSize = 0;
+
+// Data of stream sockets without network layer is transferred by the kernel, connects are still detected by polling
+#define PancakeIOUringCanTransfer(socket) \
+	(((socket)->flags & PANCAKE_NETWORK_STREAM) \
+	&& !((socket)->flags & PANCAKE_NETWORK_CONNECTING) \
+	&& (socket)->layer == NULL)
+
+PancakeModule PancakeIOUring = {
+		"IOUring",
+		PancakeIOUringInitialize,
+		NULL,
+		PancakeIOUringShutdown,
+		0
+};
+
+PancakeServerArchitecture PancakeIOUringServer = {
+		StaticString("IOUring"),
+
+		PancakeIOUringWait,
+
+		PancakeIOUringAddReadSocket,
+		PancakeIOUringAddWriteSocket,
+		PancakeIOUringAddReadWriteSocket,
+
+		PancakeIOUringRemoveReadSocket,
+		PancakeIOUringRemoveWriteSocket,
+		PancakeIOUringRemoveSocket,
+
+		PancakeIOUringSetReadSocket,
+		PancakeIOUringSetWriteSocket,
+		PancakeIOUringSetSocket,
+
+		PancakeIOUringOnSocketClose,
+
+		PancakeIOUringAcceptConnection,
+
+		PancakeIOUringRead,
+		PancakeIOUringWrite,
+
+		PancakeIOUringServerInitialize,
+
+		NULL
+};
+
+STATIC UByte PancakeIOUringInitialize() {
+	PancakeConfigurationGroup *group;
+
+	PancakeRegisterServerArchitecture(&PancakeIOUringServer);
+
+	group = PancakeConfigurationAddGroup(NULL, StaticString("IOUring"), NULL);
+	PancakeConfigurationAddSetting(group, StaticString("Entries"), CONFIG_TYPE_INT, &ringEntries, sizeof(Int32), (config_value_t) 4096, NULL);
+	PancakeConfigurationAddSetting(group, StaticString("ReceiveBuffers"), CONFIG_TYPE_INT, &numBuffers, sizeof(Int32), (config_value_t) 1024, NULL);
+	PancakeConfigurationAddSetting(group, StaticString("ReceiveBufferSize"), CONFIG_TYPE_INT, &bufferSize, sizeof(Int32), (config_value_t) 4096, NULL);
+
+	return 1;
+}
+
+STATIC void PancakeIOUringRecycleBuffer(Int32 buffer) {
+	io_uring_buf_ring_add(bufferRing, buffers + (UNative) buffer * bufferSize, bufferSize, buffer, io_uring_buf_ring_mask(numBuffers), 0);
+	io_uring_buf_ring_advance(bufferRing, 1);
+}
+
+STATIC void PancakeIOUringFreeSocket(PancakeIOUringSocket *state) {
+	UInt16 i;
+
+	if(state->flags & PANCAKE_IO_URING_LISTEN) {
+		for(i = 0; i < numListenSockets; i++) {
+			if(listenSockets[i] == state) {
+				listenSockets[i] = listenSockets[--numListenSockets];
+				break;
+			}
+		}
+	}
+
+	// Connections nobody took anymore
+	for(i = 0; i < state->numAccepted; i++) {
+		close(state->accepted[i]);
+	}
+
+	if(state->accepted) {
+		PancakeFree(state->accepted);
+	}
+
+	if(state->buffer != -1) {
+		PancakeIOUringRecycleBuffer(state->buffer);
+	}
+
+	if(state->sendBuffer) {
+		PancakeFree(state->sendBuffer);
+	}
+
+	PancakeFree(state);
+}
+
+STATIC UByte PancakeIOUringShutdown() {
+	UInt32 i;
+
+	if(haveRing) {
+		io_uring_queue_exit(&ring);
+		haveRing = 0;
+	}
+
+	// Requests in flight were discarded together with the ring
+	for(i = 0; i < socketsSize; i++) {
+		if(sockets[i]) {
+			PancakeIOUringFreeSocket(sockets[i]);
+		}
+	}
+
+	if(bufferRing) {
+		munmap(bufferRing, numBuffers * sizeof(struct io_uring_buf));
+		PancakeFree(buffers);
+
+		bufferRing = NULL;
+		buffers = NULL;
+	}
+
+	if(sockets) {
+		PancakeFree(sockets);
+	}
+
+	if(listenSockets) {
+		PancakeFree(listenSockets);
+	}
+
+	if(changedSockets) {
+		PancakeFree(changedSockets);
+	}
+
+	if(readySockets) {
+		PancakeFree(readySockets);
+	}
+
+	return 1;
+}
+
+STATIC UByte PancakeIOUringServerInitialize() {
+	Int32 retval;
+
+	// The kernel requires a power of two of at most 32768 buffers
+	if(numBuffers < 0 || numBuffers > 32768 || (numBuffers & (numBuffers - 1))) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "IOUring ReceiveBuffers must be a power of two of at most 32768 or 0");
+		return 0;
+	}
+
+	if(bufferSize <= 0) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "IOUring ReceiveBufferSize must be positive");
+		return 0;
+	}
+
+	// Just test io_uring here, to make sure everything will work
+	// The actual ring must be created in the workers as it can't be shared
+	retval = io_uring_queue_init(8, &ring, 0);
+
+	if(retval < 0) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't create io_uring instance: %s", strerror(-retval));
+		return 0;
+	}
+
+	io_uring_queue_exit(&ring);
+
+	return 1;
+}
+
+STATIC void PancakeIOUringRegisterBuffers() {
+	struct io_uring_buf_reg registration;
+	Int32 retval, i;
+
+	if(!numBuffers) {
+		return;
+	}
+
+	// Buffer ring must be page-aligned
+	bufferRing = mmap(NULL, numBuffers * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if(bufferRing == MAP_FAILED) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't allocate io_uring buffer ring: %s", strerror(errno));
+		bufferRing = NULL;
+		return;
+	}
+
+	memset(&registration, 0, sizeof(struct io_uring_buf_reg));
+	registration.ring_addr = (__u64) (UNative) bufferRing;
+	registration.ring_entries = numBuffers;
+	registration.bgid = PANCAKE_IO_URING_BUFFER_GROUP;
+
+	retval = io_uring_register_buf_ring(&ring, &registration, 0);
+
+	if(retval < 0) {
+		// Kernels before 5.19 lack buffer rings, read from sockets when they are readable instead
+		PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Can't register io_uring receive buffers, receiving synchronously: %s", strerror(-retval));
+
+		munmap(bufferRing, numBuffers * sizeof(struct io_uring_buf));
+		bufferRing = NULL;
+		return;
+	}
+
+	buffers = PancakeAllocate((UNative) numBuffers * bufferSize);
+
+	io_uring_buf_ring_init(bufferRing);
+
+	for(i = 0; i < numBuffers; i++) {
+		io_uring_buf_ring_add(bufferRing, buffers + (UNative) i * bufferSize, bufferSize, i, io_uring_buf_ring_mask(numBuffers), i);
+	}
+
+	io_uring_buf_ring_advance(bufferRing, numBuffers);
+}
+
+STATIC struct io_uring_sqe *PancakeIOUringGetSubmission() {
+	struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+
+	// Submission queue is full, pass pending requests to the kernel now
+	if(UNEXPECTED(sqe == NULL)) {
+		io_uring_submit(&ring);
+		sqe = io_uring_get_sqe(&ring);
+	}
+
+	return sqe;
+}
+
+STATIC PancakeIOUringSocket *PancakeIOUringGetSocket(PancakeSocket *socket) {
+	PancakeIOUringSocket *state;
+
+	if(socket->fd >= socketsSize) {
+		UInt32 size = socketsSize ? socketsSize : 64;
+
+		while(size <= socket->fd) {
+			size *= 2;
+		}
+
+		sockets = PancakeReallocate(sockets, size * sizeof(PancakeIOUringSocket*));
+		memset(sockets + socketsSize, 0, (size - socketsSize) * sizeof(PancakeIOUringSocket*));
+		socketsSize = size;
+	}
+
+	state = sockets[socket->fd];
+
+	if(EXPECTED(state != NULL)) {
+		return state;
+	}
+
+	state = PancakeAllocate(sizeof(PancakeIOUringSocket));
+	state->type = PANCAKE_IO_URING_REQUEST_POLL;
+	state->flags = 0;
+	state->armed = 0;
+	state->pending = 0;
+	state->socket = socket;
+
+	state->accept.type = PANCAKE_IO_URING_REQUEST_ACCEPT;
+	state->accept.parent = state;
+	state->accepted = NULL;
+	state->numAccepted = 0;
+	state->acceptedSize = 0;
+
+	state->receive.type = PANCAKE_IO_URING_REQUEST_RECEIVE;
+	state->receive.parent = state;
+	state->buffer = -1;
+	state->receivedOffset = 0;
+	state->receivedLength = 0;
+
+	state->send.type = PANCAKE_IO_URING_REQUEST_SEND;
+	state->send.parent = state;
+	state->sendBuffer = NULL;
+	state->sendBufferSize = 0;
+	state->sendLength = 0;
+	state->sendResult = 0;
+
+	// Listen sockets keep an accept request in flight instead of polling
+	if(socket->flags & PANCAKE_NETWORK_LISTEN) {
+		state->flags |= PANCAKE_IO_URING_LISTEN;
+
+		listenSockets = PancakeReallocate(listenSockets, (numListenSockets + 1) * sizeof(PancakeIOUringSocket*));
+		listenSockets[numListenSockets++] = state;
+	}
+
+	sockets[socket->fd] = state;
+
+	return state;
+}
+
+STATIC void PancakeIOUringCancel(void *request) {
+	struct io_uring_sqe *sqe = PancakeIOUringGetSubmission();
+
+	io_uring_prep_cancel64(sqe, (__u64) (UNative) request, 0);
+	io_uring_sqe_set_data(sqe, NULL);
+}
+
+STATIC void PancakeIOUringDetachSocket(PancakeSocket *socket) {
+	PancakeIOUringSocket *state;
+
+	if(socket->fd >= socketsSize || (state = sockets[socket->fd]) == NULL || state->socket != socket) {
+		return;
+	}
+
+	sockets[socket->fd] = NULL;
+	state->socket = NULL;
+
+	// Requests hold a reference to the file, cancel them explicitly
+	if(state->flags & PANCAKE_IO_URING_ACCEPTING) {
+		PancakeIOUringCancel(&state->accept);
+	}
+
+	if(state->flags & PANCAKE_IO_URING_RECEIVING) {
+		PancakeIOUringCancel(&state->receive);
+	}
+
+	if(state->flags & PANCAKE_IO_URING_SENDING) {
+		PancakeIOUringCancel(&state->send);
+	}
+
+	if(state->armed) {
+		struct io_uring_sqe *sqe = PancakeIOUringGetSubmission();
+
+		io_uring_prep_poll_remove(sqe, (__u64) (UNative) state);
+		io_uring_sqe_set_data(sqe, NULL);
+	}
+
+	// State is freed as soon as the last request completed
+	if(!state->pending) {
+		PancakeIOUringFreeSocket(state);
+	}
+}
+
+STATIC void PancakeIOUringMarkChanged(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_IO_URING_CHANGED) {
+		return;
+	}
+
+	if(numChangedSockets == changedSocketsSize) {
+		changedSocketsSize = changedSocketsSize ? changedSocketsSize * 2 : 32;
+		changedSockets = PancakeReallocate(changedSockets, changedSocketsSize * sizeof(PancakeSocket*));
+	}
+
+	changedSockets[numChangedSockets++] = socket;
+	socket->flags |= PANCAKE_IO_URING_CHANGED;
+}
+
+STATIC void PancakeIOUringMarkReady(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_IO_URING_READY) {
+		return;
+	}
+
+	if(numReadySockets == readySocketsSize) {
+		readySocketsSize = readySocketsSize ? readySocketsSize * 2 : 32;
+		readySockets = PancakeReallocate(readySockets, readySocketsSize * sizeof(PancakeSocket*));
+	}
+
+	readySockets[numReadySockets++] = socket;
+	socket->flags |= PANCAKE_IO_URING_READY;
+}
+
+STATIC void PancakeIOUringSubmitAccept(PancakeIOUringSocket *state) {
+	PancakeSocket *socket = state->socket;
+
+	if((socket->flags & PANCAKE_IO_URING_SOCKET) && (socket->flags & PANCAKE_IO_URING_IN)) {
+		struct io_uring_sqe *sqe;
+
+		if(state->flags & PANCAKE_IO_URING_ACCEPTING) {
+			return;
+		}
+
+		sqe = PancakeIOUringGetSubmission();
+
+		// Peer addresses are looked up when connections are taken, multishot requests can't return them
+		if(multishotAccept) {
+			io_uring_prep_multishot_accept(sqe, socket->fd, NULL, NULL, SOCK_NONBLOCK);
+		} else {
+			io_uring_prep_accept(sqe, socket->fd, NULL, NULL, SOCK_NONBLOCK);
+		}
+
+		io_uring_sqe_set_data(sqe, &state->accept);
+
+		state->flags |= PANCAKE_IO_URING_ACCEPTING;
+		state->pending++;
+	} else if(state->flags & PANCAKE_IO_URING_ACCEPTING) {
+		// Stop accepting, let other workers take the connections
+		PancakeIOUringCancel(&state->accept);
+	}
+}
+
+STATIC void PancakeIOUringSubmitReceive(PancakeIOUringSocket *state) {
+	struct io_uring_sqe *sqe = PancakeIOUringGetSubmission();
+
+	// Kernel picks a provided buffer once data arrived
+	io_uring_prep_recv(sqe, state->socket->fd, NULL, bufferSize, 0);
+	io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+	sqe->buf_group = PANCAKE_IO_URING_BUFFER_GROUP;
+	io_uring_sqe_set_data(sqe, &state->receive);
+
+	state->flags |= PANCAKE_IO_URING_RECEIVING;
+	state->pending++;
+}
+
+STATIC void PancakeIOUringSubmitSend(PancakeIOUringSocket *state, UByte *buffer, UInt32 length) {
+	struct io_uring_sqe *sqe;
+
+	if(length > PancakeMainConfiguration.networkBufferingMax) {
+		length = PancakeMainConfiguration.networkBufferingMax;
+	}
+
+	// Write buffer may be moved or reallocated while the request is in flight
+	if(length > state->sendBufferSize) {
+		state->sendBuffer = PancakeReallocate(state->sendBuffer, length);
+		state->sendBufferSize = length;
+	}
+
+	memcpy(state->sendBuffer, buffer, length);
+
+	sqe = PancakeIOUringGetSubmission();
+	io_uring_prep_send(sqe, state->socket->fd, state->sendBuffer, length, MSG_NOSIGNAL);
+	io_uring_sqe_set_data(sqe, &state->send);
+
+	state->sendLength = length;
+	state->flags |= PANCAKE_IO_URING_SENDING;
+	state->pending++;
+}
+
+STATIC void PancakeIOUringSubmitChanges() {
+	UInt32 i;
+
+	for(i = 0; i < numChangedSockets; i++) {
+		PancakeSocket *socket = changedSockets[i];
+		PancakeIOUringSocket *state;
+		struct io_uring_sqe *sqe;
+		UInt32 events = 0;
+
+		// Socket has been closed meanwhile
+		if(!socket) {
+			continue;
+		}
+
+		socket->flags ^= PANCAKE_IO_URING_CHANGED;
+		state = PancakeIOUringGetSocket(socket);
+
+		if(state->flags & PANCAKE_IO_URING_LISTEN) {
+			PancakeIOUringSubmitAccept(state);
+			continue;
+		}
+
+		if(socket->flags & PANCAKE_IO_URING_SOCKET) {
+			if(state->flags & PANCAKE_IO_URING_HANGUP) {
+				PancakeIOUringMarkReady(socket);
+				continue;
+			}
+
+			if(socket->flags & PANCAKE_IO_URING_IN) {
+				if(state->buffer != -1) {
+					PancakeIOUringMarkReady(socket);
+				} else if(bufferRing && PancakeIOUringCanTransfer(socket) && !(state->flags & PANCAKE_IO_URING_POLL_INPUT)) {
+					if(!(state->flags & PANCAKE_IO_URING_RECEIVING)) {
+						PancakeIOUringSubmitReceive(state);
+					}
+				} else {
+					events |= POLLIN;
+				}
+			}
+
+			if(socket->flags & PANCAKE_IO_URING_OUT) {
+				if(state->flags & PANCAKE_IO_URING_SENT) {
+					PancakeIOUringMarkReady(socket);
+				} else if(!(state->flags & PANCAKE_IO_URING_SENDING)) {
+					events |= POLLOUT;
+				}
+			}
+
+			// Receive request reports the end of the stream after all data before it
+			if(!(state->flags & PANCAKE_IO_URING_RECEIVING) && state->buffer == -1) {
+				events |= POLLRDHUP;
+			}
+		}
+
+		// Request in flight already has the requested interest set
+		if(events == state->armed) {
+			continue;
+		}
+
+		sqe = PancakeIOUringGetSubmission();
+
+		if(!state->armed) {
+			io_uring_prep_poll_add(sqe, socket->fd, events);
+			io_uring_sqe_set_data(sqe, state);
+
+			state->pending++;
+		} else if(events) {
+			// Keeps user data of the request, fails if it completed meanwhile, it will be submitted again on completion
+			io_uring_prep_poll_update(sqe, (__u64) (UNative) state, 0, events, IORING_POLL_UPDATE_EVENTS);
+			io_uring_sqe_set_data(sqe, NULL);
+		} else {
+			// Keep armed mask until the cancelled request completes
+			io_uring_prep_poll_remove(sqe, (__u64) (UNative) state);
+			io_uring_sqe_set_data(sqe, NULL);
+			continue;
+		}
+
+		state->armed = events;
+	}
+
+	numChangedSockets = 0;
+}
+
+STATIC void PancakeIOUringUpdateInterest(PancakeSocket *socket, UInt32 set, UInt32 clear) {
+	UInt32 previous = socket->flags;
+
+	socket->flags = (socket->flags & ~(clear)) | set | PANCAKE_IO_URING_SOCKET;
+
+	if(socket->flags != previous) {
+		PancakeIOUringMarkChanged(socket);
+	}
+}
+
+STATIC void PancakeIOUringAddReadSocket(PancakeSocket *socket) {
+	PancakeIOUringUpdateInterest(socket, PANCAKE_IO_URING_IN, 0);
+}
+
+STATIC void PancakeIOUringAddWriteSocket(PancakeSocket *socket) {
+	PancakeIOUringUpdateInterest(socket, PANCAKE_IO_URING_OUT, 0);
+}
+
+STATIC void PancakeIOUringAddReadWriteSocket(PancakeSocket *socket) {
+	PancakeIOUringUpdateInterest(socket, PANCAKE_IO_URING_IN | PANCAKE_IO_URING_OUT, 0);
+}
+
+STATIC void PancakeIOUringRemoveSocket(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_IO_URING_SOCKET) {
+		socket->flags &= ~(PANCAKE_IO_URING_SOCKET | PANCAKE_IO_URING_IN | PANCAKE_IO_URING_OUT);
+		PancakeIOUringMarkChanged(socket);
+	}
+}
+
+STATIC void PancakeIOUringRemoveReadSocket(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_IO_URING_IN) {
+		PancakeIOUringUpdateInterest(socket, 0, PANCAKE_IO_URING_IN);
+	}
+}
+
+STATIC void PancakeIOUringRemoveWriteSocket(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_IO_URING_OUT) {
+		PancakeIOUringUpdateInterest(socket, 0, PANCAKE_IO_URING_OUT);
+	}
+}
+
+STATIC void PancakeIOUringSetReadSocket(PancakeSocket *socket) {
+	PancakeIOUringUpdateInterest(socket, PANCAKE_IO_URING_IN, PANCAKE_IO_URING_OUT);
+}
+
+STATIC void PancakeIOUringSetWriteSocket(PancakeSocket *socket) {
+	PancakeIOUringUpdateInterest(socket, PANCAKE_IO_URING_OUT, PANCAKE_IO_URING_IN);
+}
+
+STATIC void PancakeIOUringSetSocket(PancakeSocket *socket) {
+	PancakeIOUringUpdateInterest(socket, 0, PANCAKE_IO_URING_IN | PANCAKE_IO_URING_OUT);
+}
+
+STATIC void PancakeIOUringUnlistSocket(PancakeSocket *socket, PancakeSocket **list, UInt32 length) {
+	UInt32 i;
+
+	for(i = 0; i < length; i++) {
+		if(list[i] == socket) {
+			list[i] = NULL;
+			break;
+		}
+	}
+}
+
+STATIC void PancakeIOUringOnSocketClose(PancakeSocket *socket) {
+	// Make sure we don't execute further events on this socket
+	if(socket == currentSocket) {
+		currentSocket = NULL;
+	}
+
+	// Drop pending changes and dispatches
+	if(socket->flags & PANCAKE_IO_URING_CHANGED) {
+		PancakeIOUringUnlistSocket(socket, changedSockets, numChangedSockets);
+	}
+
+	if(socket->flags & PANCAKE_IO_URING_READY) {
+		PancakeIOUringUnlistSocket(socket, readySockets, numReadySockets);
+	}
+
+	PancakeIOUringDetachSocket(socket);
+}
+
+STATIC Int32 PancakeIOUringAcceptConnection(PancakeSocket *socket, struct sockaddr *address) {
+	PancakeIOUringSocket *state = socket->fd < socketsSize ? sockets[socket->fd] : NULL;
+
+	if(state && state->numAccepted) {
+		socklen_t addressLength = sizeof(struct sockaddr);
+		Int32 fd = state->accepted[--state->numAccepted];
+
+		if(getpeername(fd, address, &addressLength) == -1) {
+			memset(address, 0, sizeof(struct sockaddr));
+		}
+
+		return fd;
+	}
+
+	errno = EAGAIN;
+	return -1;
+}
+
+STATIC Int32 PancakeIOUringRead(PancakeSocket *socket, UByte *buffer, UInt32 length) {
+	PancakeIOUringSocket *state = socket->fd < socketsSize ? sockets[socket->fd] : NULL;
+
+	if(state) {
+		if(state->buffer != -1) {
+			UInt32 available = state->receivedLength - state->receivedOffset;
+
+			if(length > available) {
+				length = available;
+			}
+
+			memcpy(buffer, buffers + (UNative) state->buffer * bufferSize + state->receivedOffset, length);
+			state->receivedOffset += length;
+
+			// Return buffer to the kernel and receive further data
+			if(state->receivedOffset == state->receivedLength) {
+				PancakeIOUringRecycleBuffer(state->buffer);
+				state->buffer = -1;
+
+				PancakeIOUringMarkChanged(socket);
+			}
+
+			return length;
+		}
+
+		// Data must not be read past a receive request in flight
+		if(state->flags & PANCAKE_IO_URING_RECEIVING) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		// Read synchronously once after running out of buffers
+		if(state->flags & PANCAKE_IO_URING_POLL_INPUT) {
+			state->flags &= ~(PANCAKE_IO_URING_POLL_INPUT);
+			PancakeIOUringMarkChanged(socket);
+		} else if(bufferRing && PancakeIOUringCanTransfer(socket)) {
+			// Further data is received once read interest is submitted
+			errno = EAGAIN;
+			return -1;
+		}
+	}
+
+	return read(socket->fd, buffer, length);
+}
+
+STATIC Int32 PancakeIOUringWrite(PancakeSocket *socket, UByte *buffer, UInt32 length) {
+	PancakeIOUringSocket *state = socket->fd < socketsSize ? sockets[socket->fd] : NULL;
+
+	// Sockets not registered yet are written synchronously
+	if(state == NULL || !PancakeIOUringCanTransfer(socket)) {
+		return write(socket->fd, buffer, length);
+	}
+
+	if(state->flags & PANCAKE_IO_URING_SENT) {
+		Int32 result = state->sendResult;
+
+		state->flags &= ~(PANCAKE_IO_URING_SENT);
+
+		if(result < 0) {
+			errno = -result;
+			return -1;
+		}
+
+		// Caller passes the rest again once it consumed the result, send it right away
+		if(result < length) {
+			PancakeIOUringSubmitSend(state, buffer + result, length - result);
+		}
+
+		return result;
+	}
+
+	if(!(state->flags & PANCAKE_IO_URING_SENDING)) {
+		PancakeIOUringSubmitSend(state, buffer, length);
+	}
+
+	// Data counts as written once the send request completed
+	errno = EAGAIN;
+	return -1;
+}
+
+STATIC UByte PancakeIOUringHaveConnections(PancakeIOUringSocket *state) {
+	return state->numAccepted > 0;
+}
+
+STATIC void PancakeIOUringDispatchConnections() {
+	UInt16 i;
+
+	for(i = 0; i < numListenSockets; i++) {
+		PancakeIOUringSocket *state = listenSockets[i];
+		PancakeSocket *socket = state->socket;
+
+		if(!socket || !(socket->flags & PANCAKE_IO_URING_IN)) {
+			continue;
+		}
+
+		// Run handler until all accepted connections are taken or it stops taking them
+		while(PancakeIOUringHaveConnections(state)) {
+			UInt16 accepted = state->numAccepted;
+
+			currentSocket = socket;
+			socket->onRead(socket);
+			PancakeCheckHeap();
+
+			if(!currentSocket || !(socket->flags & PANCAKE_IO_URING_IN) || accepted == state->numAccepted) {
+				break;
+			}
+		}
+	}
+}
+
+STATIC void PancakeIOUringDispatchReadySockets() {
+	UInt32 i;
+
+	for(i = 0; i < numReadySockets; i++) {
+		PancakeSocket *sock = readySockets[i];
+		PancakeIOUringSocket *state;
+
+		// Socket has been closed meanwhile
+		if(!sock) {
+			continue;
+		}
+
+		sock->flags &= ~(PANCAKE_IO_URING_READY);
+		state = sockets[sock->fd];
+		currentSocket = sock;
+
+		if(state->flags & PANCAKE_IO_URING_HANGUP) {
+			sock->onRemoteHangup(sock);
+			PancakeCheckHeap();
+			continue;
+		}
+
+		if((sock->flags & PANCAKE_IO_URING_IN) && state->buffer != -1) {
+			sock->onRead(sock);
+			PancakeCheckHeap();
+
+			if(!currentSocket) {
+				continue;
+			}
+		}
+
+		if((sock->flags & PANCAKE_IO_URING_OUT) && (state->flags & PANCAKE_IO_URING_SENT)) {
+			sock->onWrite(sock);
+			PancakeCheckHeap();
+
+			if(!currentSocket) {
+				continue;
+			}
+		}
+
+		PancakeIOUringMarkChanged(sock);
+	}
+
+	numReadySockets = 0;
+}
+
+STATIC void PancakeIOUringOnPoll(PancakeIOUringSocket *state, Int32 events) {
+	PancakeSocket *sock = state->socket;
+
+	state->pending--;
+	state->armed = 0;
+
+	// Socket has been closed while the request was in flight
+	if(!sock) {
+		if(!state->pending) {
+			PancakeIOUringFreeSocket(state);
+		}
+
+		return;
+	}
+
+	// Request was cancelled or updated, submit again with current interest
+	if(events < 0 || !(sock->flags & PANCAKE_IO_URING_SOCKET)) {
+		PancakeIOUringMarkChanged(sock);
+		return;
+	}
+
+	if(((events & POLLHUP) && !(events & POLLRDHUP)) || (events & POLLERR)) {
+		sock->onRemoteHangup(sock);
+		PancakeCheckHeap();
+		return;
+	}
+
+	currentSocket = sock;
+
+	if((events & POLLIN) && (sock->flags & PANCAKE_IO_URING_IN)) {
+		sock->onRead(sock);
+		PancakeCheckHeap();
+
+		// Socket has been closed in onRead()
+		if(!currentSocket) {
+			return;
+		}
+	}
+
+	if((events & POLLOUT) && (sock->flags & PANCAKE_IO_URING_OUT)) {
+		sock->onWrite(sock);
+		PancakeCheckHeap();
+
+		// Socket has been closed in onWrite()
+		if(!currentSocket) {
+			return;
+		}
+	}
+
+	if(events & POLLRDHUP) {
+		sock->onRemoteHangup(sock);
+		PancakeCheckHeap();
+
+		if(!currentSocket) {
+			return;
+		}
+	}
+
+	// Poll requests complete once, submit again with current interest
+	PancakeIOUringMarkChanged(sock);
+}
+
+STATIC void PancakeIOUringOnAccept(PancakeIOUringSocket *state, Int32 fd, UInt32 flags) {
+	// Multishot requests stay in flight until the kernel reports otherwise
+	if(!(flags & IORING_CQE_F_MORE)) {
+		state->flags &= ~(PANCAKE_IO_URING_ACCEPTING);
+		state->pending--;
+	}
+
+	// Listen socket has been closed while the request was in flight
+	if(!state->socket) {
+		if(fd >= 0) {
+			close(fd);
+		}
+
+		if(!state->pending) {
+			PancakeIOUringFreeSocket(state);
+		}
+
+		return;
+	}
+
+	if(fd >= 0) {
+		if(state->numAccepted == state->acceptedSize) {
+			state->acceptedSize = state->acceptedSize ? state->acceptedSize * 2 : 16;
+			state->accepted = PancakeReallocate(state->accepted, state->acceptedSize * sizeof(Int32));
+		}
+
+		state->accepted[state->numAccepted++] = fd;
+	} else if(fd == -EINVAL && multishotAccept) {
+		// Kernel does not support multishot accept requests
+		multishotAccept = 0;
+	} else if(fd != -ECANCELED && fd != -EAGAIN) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "accept failed: %s", strerror(-fd));
+	}
+
+	if(!(state->flags & PANCAKE_IO_URING_ACCEPTING)) {
+		PancakeIOUringMarkChanged(state->socket);
+	}
+}
+
+STATIC void PancakeIOUringOnReceive(PancakeIOUringSocket *state, Int32 length, UInt32 flags) {
+	PancakeSocket *sock = state->socket;
+	Int32 buffer = flags & IORING_CQE_F_BUFFER ? (Int32) (flags >> IORING_CQE_BUFFER_SHIFT) : -1;
+
+	state->pending--;
+	state->flags &= ~(PANCAKE_IO_URING_RECEIVING);
+
+	// Socket has been closed while the request was in flight
+	if(!sock) {
+		if(buffer != -1) {
+			PancakeIOUringRecycleBuffer(buffer);
+		}
+
+		if(!state->pending) {
+			PancakeIOUringFreeSocket(state);
+		}
+
+		return;
+	}
+
+	if(length > 0) {
+		state->buffer = buffer;
+		state->receivedOffset = 0;
+		state->receivedLength = length;
+
+		if(sock->flags & PANCAKE_IO_URING_IN) {
+			currentSocket = sock;
+			sock->onRead(sock);
+			PancakeCheckHeap();
+
+			// Socket has been closed in onRead()
+			if(!currentSocket) {
+				return;
+			}
+		}
+	} else {
+		if(buffer != -1) {
+			PancakeIOUringRecycleBuffer(buffer);
+		}
+
+		if(length == -ENOBUFS || length == -EAGAIN) {
+			// Out of provided buffers, wait until the socket is readable
+			state->flags |= PANCAKE_IO_URING_POLL_INPUT;
+		} else if(length != -ECANCELED) {
+			// End of stream or connection error
+			state->flags |= PANCAKE_IO_URING_HANGUP;
+
+			if(sock->flags & PANCAKE_IO_URING_SOCKET) {
+				sock->onRemoteHangup(sock);
+				PancakeCheckHeap();
+				return;
+			}
+		}
+	}
+
+	PancakeIOUringMarkChanged(sock);
+}
+
+STATIC void PancakeIOUringOnSend(PancakeIOUringSocket *state, Int32 length) {
+	PancakeSocket *sock = state->socket;
+
+	state->pending--;
+	state->flags &= ~(PANCAKE_IO_URING_SENDING);
+
+	// Socket has been closed while the request was in flight
+	if(!sock) {
+		if(!state->pending) {
+			PancakeIOUringFreeSocket(state);
+		}
+
+		return;
+	}
+
+	// Result is picked up by the next write
+	state->sendResult = length;
+	state->flags |= PANCAKE_IO_URING_SENT;
+
+	if(sock->flags & PANCAKE_IO_URING_OUT) {
+		currentSocket = sock;
+		sock->onWrite(sock);
+		PancakeCheckHeap();
+
+		// Socket has been closed in onWrite()
+		if(!currentSocket) {
+			return;
+		}
+	}
+
+	PancakeIOUringMarkChanged(sock);
+}
+
+STATIC void PancakeIOUringWait() {
+	Int32 retval;
+
+	retval = io_uring_queue_init(ringEntries, &ring, 0);
+
+	if(retval < 0) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't create io_uring instance: %s", strerror(-retval));
+		return;
+	}
+
+	haveRing = 1;
+
+	PancakeIOUringRegisterBuffers();
+
+	// Activate listen sockets
+	PancakeNetworkActivateListenSockets();
+
+	while(1) {
+		struct io_uring_cqe *cqes[64];
+		struct __kernel_timespec timeout;
+		void *data[64];
+		Int32 results[64];
+		UInt32 flags[64];
+		UInt32 numCompletions, i, milliseconds;
+
+		// Interest changes and the wait for completions share a single io_uring_enter
+		PancakeIOUringSubmitChanges();
+
+		if(numReadySockets) {
+			// Don't wait while there is data to dispatch already
+			retval = io_uring_submit(&ring);
+		} else {
+			milliseconds = PancakeSchedulerGetNextExecutionTimeOffsetMilliseconds();
+			timeout.tv_sec = milliseconds / 1000;
+			timeout.tv_nsec = (milliseconds % 1000) * 1000000;
+
+			retval = io_uring_submit_and_wait_timeout(&ring, cqes, 1, &timeout, NULL);
+		}
+
+		// Refresh cached clock once per iteration
+		PancakeUpdateNow();
+
+		if(UNEXPECTED(retval < 0 && retval != -ETIME)) {
+			// Let active connections finish before stopping
+			if(PancakeDoShutdown) {
+				if(PancakeNetworkDrain()) {
+					return;
+				}
+
+				continue;
+			}
+
+			if(retval == -EINTR) {
+				continue;
+			}
+
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "io_uring_submit_and_wait_timeout failed: %s", strerror(-retval));
+			return;
+		}
+
+		// Copy completions first as handlers might submit new requests
+		numCompletions = io_uring_peek_batch_cqe(&ring, cqes, 64);
+
+		for(i = 0; i < numCompletions; i++) {
+			data[i] = io_uring_cqe_get_data(cqes[i]);
+			results[i] = cqes[i]->res;
+			flags[i] = cqes[i]->flags;
+		}
+
+		io_uring_cq_advance(&ring, numCompletions);
+
+		// Network events first
+		for(i = 0; i < numCompletions; i++) {
+			// Completions of cancel, update and remove requests
+			if(data[i] == NULL) {
+				continue;
+			}
+
+			switch(*((UByte*) data[i])) {
+				case PANCAKE_IO_URING_REQUEST_POLL:
+					PancakeIOUringOnPoll((PancakeIOUringSocket*) data[i], results[i]);
+					break;
+				case PANCAKE_IO_URING_REQUEST_ACCEPT:
+					PancakeIOUringOnAccept(((PancakeIOUringRequest*) data[i])->parent, results[i], flags[i]);
+					break;
+				case PANCAKE_IO_URING_REQUEST_RECEIVE:
+					PancakeIOUringOnReceive(((PancakeIOUringRequest*) data[i])->parent, results[i], flags[i]);
+					break;
+				case PANCAKE_IO_URING_REQUEST_SEND:
+					PancakeIOUringOnSend(((PancakeIOUringRequest*) data[i])->parent, results[i]);
+					break;
+			}
+		}
+
+		PancakeIOUringDispatchReadySockets();
+		PancakeIOUringDispatchConnections();
+
+		// Scheduler events second
+		PancakeSchedulerRun();
+
+		if(UNEXPECTED(PancakeDoShutdown) && PancakeNetworkDrain()) {
+			return;
+		}
+	}
+}
@@ -0,0 +1,71 @@
+
+#ifndef _PANCAKE_IO_URING_H
+#define _PANCAKE_IO_URING_H
+
+#include "../Pancake.h"
+#include "../PancakeNetwork.h"
+
+#include <liburing.h>
+
+extern PancakeModule PancakeIOUring;
+
+#define PANCAKE_IO_URING_SOCKET 	1 << 10
+#define PANCAKE_IO_URING_IN 		1 << 11
+#define PANCAKE_IO_URING_OUT		1 << 12
+#define PANCAKE_IO_URING_CHANGED	1 << 13
+#define PANCAKE_IO_URING_READY		1 << 14
+
+/* Group of the provided receive buffers */
+#define PANCAKE_IO_URING_BUFFER_GROUP 0
+
+#define PANCAKE_IO_URING_REQUEST_POLL 1
+#define PANCAKE_IO_URING_REQUEST_ACCEPT 2
+#define PANCAKE_IO_URING_REQUEST_RECEIVE 3
+#define PANCAKE_IO_URING_REQUEST_SEND 4
+
+/* Transfer state of sockets */
+#define PANCAKE_IO_URING_ACCEPTING 	1 << 0
+#define PANCAKE_IO_URING_RECEIVING 	1 << 1
+#define PANCAKE_IO_URING_SENDING 	1 << 2
+#define PANCAKE_IO_URING_SENT 		1 << 3
+#define PANCAKE_IO_URING_HANGUP 	1 << 4
+#define PANCAKE_IO_URING_POLL_INPUT 1 << 5
+#define PANCAKE_IO_URING_LISTEN 	1 << 6
+
+typedef struct _PancakeIOUringSocket PancakeIOUringSocket;
+
+typedef struct _PancakeIOUringRequest {
+	UByte type;
+
+	PancakeIOUringSocket *parent;
+} PancakeIOUringRequest;
+
+typedef struct _PancakeIOUringSocket {
+	UByte type;
+	UByte flags;
+	UInt32 armed;
+	UInt32 pending;
+
+	PancakeSocket *socket;
+
+	/* Connections accepted by the multishot accept request of listen sockets */
+	PancakeIOUringRequest accept;
+	Int32 *accepted;
+	UInt16 numAccepted;
+	UInt16 acceptedSize;
+
+	/* Provided buffer holding received data not yet read */
+	PancakeIOUringRequest receive;
+	Int32 buffer;
+	UInt32 receivedOffset;
+	UInt32 receivedLength;
+
+	/* Copy of the data being sent */
+	PancakeIOUringRequest send;
+	UByte *sendBuffer;
+	UInt32 sendBufferSize;
+	UInt32 sendLength;
+	Int32 sendResult;
+} PancakeIOUringSocket;
+
+#endif
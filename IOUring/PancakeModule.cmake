@@ -0,0 +1,11 @@
+option(PANCAKE_IO_URING "Enable Pancake Linux io_uring server architecture module" OFF)
+
+if(PANCAKE_IO_URING)
+    pancake_enable_module("IOUring" "PancakeIOUring" "IOUring/PancakeIOUring.h")
+    set(HAVE_SERVER_ARCHITECTURE 1)
+    set(PANCAKE_SOURCE_FILES ${PANCAKE_SOURCE_FILES} "IOUring/PancakeIOUring.c")
+    require_include_file("liburing.h")
+    require_library("uring" "io_uring_submit_and_wait_timeout" "")
+    require_library("uring" "io_uring_register_buf_ring" "")
+    pancake_link_library("uring")
+endif()
@@ -3,6 +3,7 @@
 #include "../PancakeConfiguration.h"
 #include "../PancakeLogger.h"
 #include "../PancakeScheduler.h"
+#include "../PancakeDateTime.h"
 
 Int32 PancakeLinuxPollFD = -1;
 
@@ -27,6 +28,30 @@ STATIC void PancakeLinuxPollOnSocketClose(PancakeSocket *socket);
 
 static PancakeSocket *currentSocket = NULL;
 
+/* Sockets with interest changes not yet passed to the kernel */
+static PancakeSocket **changedSockets = NULL;
+static UInt32 numChangedSockets = 0;
+static UInt32 changedSocketsSize = 0;
+
+/* Edge-triggered mode */
+static UByte edgeTriggered = 0;
+static PancakeSocket **readySockets = NULL;
+static UInt32 numReadySockets = 0;
+static UInt32 readySocketsSize = 0;
+
+/* Debug counters */
+static UNative numControlCalls = 0;
+static UNative numAvoidedControlCalls = 0;
+
+// Sockets with a network layer stay level-triggered as the layer might buffer data internally,
+// EPOLLEXCLUSIVE listen sockets must be removed from the epoll instance to stop accepting
+#define PancakeLinuxPollIsEdgeTriggered(socket) \
+	(((socket)->flags & PANCAKE_LINUX_POLL_EDGE) \
+	|| (edgeTriggered \
+		&& !((socket)->flags & PANCAKE_LINUX_POLL_SOCKET) \
+		&& !((socket)->flags & PANCAKE_NETWORK_ACCEPT_EXCLUSIVE) \
+		&& (socket)->layer == NULL))
+
 PancakeModule PancakeLinuxPoll = {
 		"LinuxPoll",
 		PancakeLinuxPollInitialize,
@@ -55,14 +80,24 @@ PancakeServerArchitecture PancakeLinuxPollServer = {
 
 		PancakeLinuxPollOnSocketClose,
 
+		NULL,
+
+		NULL,
+		NULL,
+
 		PancakeLinuxPollServerInitialize,
 
 		NULL
 };
 
 STATIC UByte PancakeLinuxPollInitialize() {
+	PancakeConfigurationGroup *group;
+
 	PancakeRegisterServerArchitecture(&PancakeLinuxPollServer);
 
+	group = PancakeConfigurationAddGroup(NULL, StaticString("LinuxPoll"), NULL);
+	PancakeConfigurationAddSetting(group, StaticString("EdgeTriggered"), CONFIG_TYPE_BOOL, &edgeTriggered, sizeof(UByte), (config_value_t) 0, NULL);
+
 	return 1;
 }
 
@@ -71,6 +106,20 @@ STATIC UByte PancakeLinuxPollShutdown() {
 		close(PancakeLinuxPollFD);
 	}
 
+	PancakeDebug {
+		if(numControlCalls || numAvoidedControlCalls) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "LinuxPoll: %lu epoll_ctl calls, %lu avoided", (unsigned long) numControlCalls, (unsigned long) numAvoidedControlCalls);
+		}
+	}
+
+	if(changedSockets) {
+		PancakeFree(changedSockets);
+	}
+
+	if(readySockets) {
+		PancakeFree(readySockets);
+	}
+
 	return 1;
 }
 
@@ -92,166 +141,253 @@ STATIC UByte PancakeLinuxPollServerInitialize() {
 	return 1;
 }
 
-STATIC inline void PancakeLinuxPollAddReadSocket(PancakeSocket *socket) {
-	if(socket->flags & PANCAKE_LINUX_POLL_SOCKET) {
-		if(!(socket->flags & PANCAKE_LINUX_POLL_IN)) {
-			struct epoll_event event;
+STATIC void PancakeLinuxPollControl(PancakeSocket *socket, Int32 operation, UInt32 events) {
+	struct epoll_event event;
 
-			socket->flags |= PANCAKE_LINUX_POLL_IN;
-			event.events = EPOLLIN | EPOLLRDHUP | (socket->flags & PANCAKE_LINUX_POLL_OUT ? EPOLLOUT : 0);
-			event.data.ptr = (void*) socket;
+	event.events = events;
+	event.data.ptr = (void*) socket;
 
-			epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_MOD, socket->fd, &event);
-		}
-	} else {
-		struct epoll_event event;
+	epoll_ctl(PancakeLinuxPollFD, operation, socket->fd, &event);
+	numControlCalls++;
+}
 
-		socket->flags |= PANCAKE_LINUX_POLL_IN | PANCAKE_LINUX_POLL_SOCKET;
-		event.events = EPOLLIN | EPOLLRDHUP;
-		event.data.ptr = (void*) socket;
+STATIC void PancakeLinuxPollMarkChanged(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_LINUX_POLL_CHANGED) {
+		// Merged with a change that is not flushed yet
+		numAvoidedControlCalls++;
+		return;
+	}
 
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_ADD, socket->fd, &event);
+	if(numChangedSockets == changedSocketsSize) {
+		changedSocketsSize = changedSocketsSize ? changedSocketsSize * 2 : 32;
+		changedSockets = PancakeReallocate(changedSockets, changedSocketsSize * sizeof(PancakeSocket*));
 	}
+
+	changedSockets[numChangedSockets++] = socket;
+	socket->flags |= PANCAKE_LINUX_POLL_CHANGED;
 }
 
-STATIC inline void PancakeLinuxPollAddWriteSocket(PancakeSocket *socket) {
-	if(socket->flags & PANCAKE_LINUX_POLL_SOCKET) {
-		if(!(socket->flags & PANCAKE_LINUX_POLL_OUT)) {
-			struct epoll_event event;
+STATIC void PancakeLinuxPollFlushChanges() {
+	UInt32 i;
 
-			socket->flags |= PANCAKE_LINUX_POLL_OUT;
-			event.events = EPOLLOUT | EPOLLRDHUP | (socket->flags & PANCAKE_LINUX_POLL_IN ? EPOLLIN : 0);
-			event.data.ptr = (void*) socket;
+	for(i = 0; i < numChangedSockets; i++) {
+		PancakeSocket *socket = changedSockets[i];
+		UInt32 registered, events;
 
-			epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_MOD, socket->fd, &event);
+		// Socket has been closed meanwhile
+		if(!socket) {
+			continue;
 		}
-	} else {
-		struct epoll_event event;
 
-		socket->flags |= PANCAKE_LINUX_POLL_OUT | PANCAKE_LINUX_POLL_SOCKET;
-		event.events = EPOLLOUT | EPOLLRDHUP;
-		event.data.ptr = (void*) socket;
+		socket->flags ^= PANCAKE_LINUX_POLL_CHANGED;
 
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_ADD, socket->fd, &event);
-	}
-}
+		if(!(socket->flags & PANCAKE_LINUX_POLL_SOCKET)) {
+			if(socket->flags & PANCAKE_LINUX_POLL_REGISTERED) {
+				PancakeLinuxPollControl(socket, EPOLL_CTL_DEL, 0);
+				socket->flags &= ~(PANCAKE_LINUX_POLL_REGISTERED | PANCAKE_LINUX_POLL_REGISTERED_IN | PANCAKE_LINUX_POLL_REGISTERED_OUT);
+			} else {
+				numAvoidedControlCalls++;
+			}
 
-STATIC inline void PancakeLinuxPollAddReadWriteSocket(PancakeSocket *socket) {
-	if(socket->flags & PANCAKE_LINUX_POLL_SOCKET) {
-		if((socket->flags & (PANCAKE_LINUX_POLL_OUT | PANCAKE_LINUX_POLL_IN)) != (PANCAKE_LINUX_POLL_OUT | PANCAKE_LINUX_POLL_IN)) {
-			struct epoll_event event;
+			continue;
+		}
 
-			socket->flags |= PANCAKE_LINUX_POLL_OUT | PANCAKE_LINUX_POLL_IN;
-			event.events = EPOLLOUT | EPOLLRDHUP | EPOLLIN;
-			event.data.ptr = (void*) socket;
+		if(socket->flags & PANCAKE_LINUX_POLL_EDGE) {
+			// Register once for all events, readiness is tracked in the socket flags
+			// The kernel reports the current readiness on registration
+			if(!(socket->flags & PANCAKE_LINUX_POLL_REGISTERED)) {
+				PancakeLinuxPollControl(socket, EPOLL_CTL_ADD, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+				socket->flags |= PANCAKE_LINUX_POLL_REGISTERED;
+			}
 
-			epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_MOD, socket->fd, &event);
+			continue;
 		}
-	} else {
-		struct epoll_event event;
 
-		socket->flags |= PANCAKE_LINUX_POLL_OUT | PANCAKE_LINUX_POLL_IN | PANCAKE_LINUX_POLL_SOCKET;
-		event.events = EPOLLOUT | EPOLLIN | EPOLLRDHUP;
-		event.data.ptr = (void*) socket;
+		registered = (socket->flags & PANCAKE_LINUX_POLL_IN ? PANCAKE_LINUX_POLL_REGISTERED_IN : 0)
+					| (socket->flags & PANCAKE_LINUX_POLL_OUT ? PANCAKE_LINUX_POLL_REGISTERED_OUT : 0);
 
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_ADD, socket->fd, &event);
-	}
-}
+		// Kernel already has the requested interest set
+		if((socket->flags & PANCAKE_LINUX_POLL_REGISTERED)
+		&& (socket->flags & (PANCAKE_LINUX_POLL_REGISTERED_IN | PANCAKE_LINUX_POLL_REGISTERED_OUT)) == registered) {
+			numAvoidedControlCalls++;
+			continue;
+		}
 
-STATIC inline void PancakeLinuxPollRemoveSocket(PancakeSocket *socket) {
-	if(socket->flags & PANCAKE_LINUX_POLL_SOCKET) {
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_DEL, socket->fd, NULL);
-		socket->flags ^= PANCAKE_LINUX_POLL_SOCKET;
-	}
-}
+		events = EPOLLRDHUP
+				| (socket->flags & PANCAKE_LINUX_POLL_IN ? EPOLLIN : 0)
+				| (socket->flags & PANCAKE_LINUX_POLL_OUT ? EPOLLOUT : 0);
 
-STATIC inline void PancakeLinuxPollRemoveReadSocket(PancakeSocket *socket) {
-	if(socket->flags & PANCAKE_LINUX_POLL_IN) {
-		struct epoll_event event;
+#ifdef EPOLLEXCLUSIVE
+		if(socket->flags & PANCAKE_NETWORK_ACCEPT_EXCLUSIVE) {
+			// EPOLLEXCLUSIVE registrations can't be modified, register again instead
+			if(socket->flags & PANCAKE_LINUX_POLL_REGISTERED) {
+				PancakeLinuxPollControl(socket, EPOLL_CTL_DEL, 0);
+				socket->flags &= ~(PANCAKE_LINUX_POLL_REGISTERED | PANCAKE_LINUX_POLL_REGISTERED_IN | PANCAKE_LINUX_POLL_REGISTERED_OUT);
+			}
 
-		event.events = EPOLLRDHUP | (socket->flags & PANCAKE_LINUX_POLL_OUT ? EPOLLOUT : 0);
-		event.data.ptr = (void*) socket;
+			if(!(socket->flags & PANCAKE_LINUX_POLL_IN)) {
+				continue;
+			}
+
+			// Wake only one worker per incoming connection (EPOLLRDHUP may not be combined with EPOLLEXCLUSIVE)
+			events = EPOLLIN | EPOLLEXCLUSIVE;
+			registered = PANCAKE_LINUX_POLL_REGISTERED_IN;
+		}
+#endif
 
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_MOD, socket->fd, &event);
-		socket->flags ^= PANCAKE_LINUX_POLL_IN;
+		PancakeLinuxPollControl(socket, socket->flags & PANCAKE_LINUX_POLL_REGISTERED ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, events);
+		socket->flags = (socket->flags & ~(PANCAKE_LINUX_POLL_REGISTERED_IN | PANCAKE_LINUX_POLL_REGISTERED_OUT)) | registered | PANCAKE_LINUX_POLL_REGISTERED;
 	}
+
+	numChangedSockets = 0;
 }
 
-STATIC inline void PancakeLinuxPollRemoveWriteSocket(PancakeSocket *socket) {
-	if(socket->flags & PANCAKE_LINUX_POLL_OUT) {
-		struct epoll_event event;
+STATIC void PancakeLinuxPollQueueReadySocket(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_LINUX_POLL_QUEUED) {
+		return;
+	}
 
-		event.events = EPOLLRDHUP | (socket->flags & PANCAKE_LINUX_POLL_IN ? EPOLLIN : 0);
-		event.data.ptr = (void*) socket;
+	// Only queue sockets that are ready for one of the requested events
+	if(!((socket->flags & PANCAKE_LINUX_POLL_IN) && (socket->flags & PANCAKE_NETWORK_READABLE))
+	&& !((socket->flags & PANCAKE_LINUX_POLL_OUT) && (socket->flags & PANCAKE_NETWORK_WRITABLE))) {
+		return;
+	}
 
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_MOD, socket->fd, &event);
-		socket->flags ^= PANCAKE_LINUX_POLL_OUT;
+	if(numReadySockets == readySocketsSize) {
+		readySocketsSize = readySocketsSize ? readySocketsSize * 2 : 32;
+		readySockets = PancakeReallocate(readySockets, readySocketsSize * sizeof(PancakeSocket*));
 	}
+
+	readySockets[numReadySockets++] = socket;
+	socket->flags |= PANCAKE_LINUX_POLL_QUEUED;
 }
 
-STATIC inline void PancakeLinuxPollSetReadSocket(PancakeSocket *socket) {
-	struct epoll_event event;
+STATIC inline void PancakeLinuxPollUnlistSocket(PancakeSocket *socket, PancakeSocket **list, UInt32 length) {
+	UInt32 i;
 
-	event.events = EPOLLRDHUP | EPOLLIN;
-	event.data.ptr = (void*) socket;
+	for(i = 0; i < length; i++) {
+		if(list[i] == socket) {
+			list[i] = NULL;
+			return;
+		}
+	}
+}
 
-	socket->flags |= PANCAKE_LINUX_POLL_IN;
+STATIC void PancakeLinuxPollUpdateInterest(PancakeSocket *socket, UInt32 set, UInt32 clear) {
+	UInt32 previous = socket->flags;
 
-	if(socket->flags & PANCAKE_LINUX_POLL_SOCKET) {
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_MOD, socket->fd, &event);
+	if(PancakeLinuxPollIsEdgeTriggered(socket)) {
+		socket->flags = (socket->flags & ~(clear)) | set;
 
-		if(socket->flags & PANCAKE_LINUX_POLL_OUT) {
-			socket->flags ^= PANCAKE_LINUX_POLL_OUT;
+		if(!(socket->flags & PANCAKE_LINUX_POLL_SOCKET)) {
+			socket->flags |= PANCAKE_LINUX_POLL_SOCKET | PANCAKE_LINUX_POLL_EDGE;
+			PancakeLinuxPollMarkChanged(socket);
+			return;
 		}
-	} else {
-		socket->flags |= PANCAKE_LINUX_POLL_SOCKET;
 
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_ADD, socket->fd, &event);
+		// Interest changes of registered edge-triggered sockets never reach the kernel
+		if(socket->flags != previous) {
+			numAvoidedControlCalls++;
+		}
+
+		PancakeLinuxPollQueueReadySocket(socket);
+		return;
 	}
-}
 
-STATIC inline void PancakeLinuxPollSetWriteSocket(PancakeSocket *socket) {
-	struct epoll_event event;
+	socket->flags = (socket->flags & ~(clear)) | set | PANCAKE_LINUX_POLL_SOCKET;
 
-	event.events = EPOLLRDHUP | EPOLLOUT;
-	event.data.ptr = (void*) socket;
+	if(socket->flags != previous) {
+		PancakeLinuxPollMarkChanged(socket);
+	}
+}
 
-	socket->flags |= PANCAKE_LINUX_POLL_OUT;
+STATIC void PancakeLinuxPollEdgeTriggeredDispatch(PancakeSocket *sock) {
+	currentSocket = sock;
 
-	if(socket->flags & PANCAKE_LINUX_POLL_SOCKET) {
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_MOD, socket->fd, &event);
+	if((sock->flags & PANCAKE_LINUX_POLL_IN) && (sock->flags & PANCAKE_NETWORK_READABLE)) {
+		sock->onRead(sock);
+		PancakeCheckHeap();
 
-		if(socket->flags & PANCAKE_LINUX_POLL_IN) {
-			socket->flags ^= PANCAKE_LINUX_POLL_IN;
+		// Socket has been closed in onRead()
+		if(!currentSocket) {
+			return;
 		}
-	} else {
-		socket->flags |= PANCAKE_LINUX_POLL_SOCKET;
+	}
+
+	if((sock->flags & PANCAKE_LINUX_POLL_OUT) && (sock->flags & PANCAKE_NETWORK_WRITABLE)) {
+		sock->onWrite(sock);
+		PancakeCheckHeap();
 
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_ADD, socket->fd, &event);
+		// Socket has been closed in onWrite()
+		if(!currentSocket) {
+			return;
+		}
 	}
+
+	// Handlers did not drain the socket, serve it again in the next iteration
+	PancakeLinuxPollQueueReadySocket(sock);
 }
 
-STATIC inline void PancakeLinuxPollSetSocket(PancakeSocket *socket) {
-	struct epoll_event event;
+STATIC inline void PancakeLinuxPollAddReadSocket(PancakeSocket *socket) {
+	PancakeLinuxPollUpdateInterest(socket, PANCAKE_LINUX_POLL_IN, 0);
+}
 
-	event.events = EPOLLRDHUP;
-	event.data.ptr = (void*) socket;
+STATIC inline void PancakeLinuxPollAddWriteSocket(PancakeSocket *socket) {
+	PancakeLinuxPollUpdateInterest(socket, PANCAKE_LINUX_POLL_OUT, 0);
+}
+
+STATIC inline void PancakeLinuxPollAddReadWriteSocket(PancakeSocket *socket) {
+	PancakeLinuxPollUpdateInterest(socket, PANCAKE_LINUX_POLL_IN | PANCAKE_LINUX_POLL_OUT, 0);
+}
+
+STATIC inline void PancakeLinuxPollRemoveSocket(PancakeSocket *socket) {
+	if(!(socket->flags & PANCAKE_LINUX_POLL_SOCKET)) {
+		return;
+	}
 
-	if(socket->flags & PANCAKE_LINUX_POLL_SOCKET) {
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_MOD, socket->fd, &event);
+	socket->flags &= ~(PANCAKE_LINUX_POLL_SOCKET | PANCAKE_LINUX_POLL_IN | PANCAKE_LINUX_POLL_OUT);
 
-		if(socket->flags & PANCAKE_LINUX_POLL_IN) {
-			socket->flags ^= PANCAKE_LINUX_POLL_IN;
+	if(socket->flags & PANCAKE_LINUX_POLL_EDGE) {
+		// Remove immediately as readiness is only reported again on registration
+		if(socket->flags & PANCAKE_LINUX_POLL_REGISTERED) {
+			PancakeLinuxPollControl(socket, EPOLL_CTL_DEL, 0);
 		}
 
-		if(socket->flags & PANCAKE_LINUX_POLL_OUT) {
-			socket->flags ^= PANCAKE_LINUX_POLL_OUT;
+		socket->flags &= ~(PANCAKE_LINUX_POLL_EDGE | PANCAKE_LINUX_POLL_REGISTERED | PANCAKE_NETWORK_READABLE | PANCAKE_NETWORK_WRITABLE);
+
+		if(socket->flags & PANCAKE_LINUX_POLL_QUEUED) {
+			PancakeLinuxPollUnlistSocket(socket, readySockets, numReadySockets);
+			socket->flags ^= PANCAKE_LINUX_POLL_QUEUED;
 		}
-	} else {
-		socket->flags |= PANCAKE_LINUX_POLL_SOCKET;
 
-		epoll_ctl(PancakeLinuxPollFD, EPOLL_CTL_ADD, socket->fd, &event);
+		return;
 	}
+
+	PancakeLinuxPollMarkChanged(socket);
+}
+
+STATIC inline void PancakeLinuxPollRemoveReadSocket(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_LINUX_POLL_IN) {
+		PancakeLinuxPollUpdateInterest(socket, 0, PANCAKE_LINUX_POLL_IN);
+	}
+}
+
+STATIC inline void PancakeLinuxPollRemoveWriteSocket(PancakeSocket *socket) {
+	if(socket->flags & PANCAKE_LINUX_POLL_OUT) {
+		PancakeLinuxPollUpdateInterest(socket, 0, PANCAKE_LINUX_POLL_OUT);
+	}
+}
+
+STATIC inline void PancakeLinuxPollSetReadSocket(PancakeSocket *socket) {
+	PancakeLinuxPollUpdateInterest(socket, PANCAKE_LINUX_POLL_IN, PANCAKE_LINUX_POLL_OUT);
+}
+
+STATIC inline void PancakeLinuxPollSetWriteSocket(PancakeSocket *socket) {
+	PancakeLinuxPollUpdateInterest(socket, PANCAKE_LINUX_POLL_OUT, PANCAKE_LINUX_POLL_IN);
+}
+
+STATIC inline void PancakeLinuxPollSetSocket(PancakeSocket *socket) {
+	PancakeLinuxPollUpdateInterest(socket, 0, PANCAKE_LINUX_POLL_IN | PANCAKE_LINUX_POLL_OUT);
 }
 
 STATIC inline void PancakeLinuxPollOnSocketClose(PancakeSocket *socket) {
@@ -261,6 +397,15 @@ STATIC inline void PancakeLinuxPollOnSocketClose(PancakeSocket *socket) {
 	if(socket == currentSocket) {
 		currentSocket = NULL;
 	}
+
+	// Drop pending changes
+	if(socket->flags & PANCAKE_LINUX_POLL_CHANGED) {
+		PancakeLinuxPollUnlistSocket(socket, changedSockets, numChangedSockets);
+	}
+
+	if(socket->flags & PANCAKE_LINUX_POLL_QUEUED) {
+		PancakeLinuxPollUnlistSocket(socket, readySockets, numReadySockets);
+	}
 }
 
 STATIC void PancakeLinuxPollWait() {
@@ -278,12 +423,25 @@ STATIC void PancakeLinuxPollWait() {
 	while(1) {
 		struct epoll_event events[32];
 		Int32 numEvents, i;
+		UInt32 numReady = numReadySockets;
+
+		// Pass interest changes to the kernel
+		PancakeLinuxPollFlushChanges();
 
-		numEvents = epoll_wait(PancakeLinuxPollFD, events, 32, PancakeSchedulerGetNextExecutionTimeOffset() * 1000);
+		// Don't block while sockets are still ready from previous iterations
+		numEvents = epoll_wait(PancakeLinuxPollFD, events, 32, numReady ? 0 : PancakeSchedulerGetNextExecutionTimeOffsetMilliseconds());
+
+		// Refresh cached clock once per iteration
+		PancakeUpdateNow();
 
 		if(UNEXPECTED(numEvents == -1)) {
+			// Let active connections finish before stopping
 			if(PancakeDoShutdown) {
-				return;
+				if(PancakeNetworkDrain()) {
+					return;
+				}
+
+				continue;
 			}
 
 			if(errno == EINTR) {
@@ -304,6 +462,20 @@ STATIC void PancakeLinuxPollWait() {
 				continue;
 			}
 
+			if(sock->flags & PANCAKE_LINUX_POLL_EDGE) {
+				sock->flags |= (events[i].events & EPOLLIN ? PANCAKE_NETWORK_READABLE : 0)
+							| (events[i].events & EPOLLOUT ? PANCAKE_NETWORK_WRITABLE : 0);
+
+				PancakeLinuxPollEdgeTriggeredDispatch(sock);
+
+				if((events[i].events & EPOLLRDHUP) && currentSocket) {
+					sock->onRemoteHangup(sock);
+					PancakeCheckHeap();
+				}
+
+				continue;
+			}
+
 			currentSocket = sock;
 
 			if(events[i].events & EPOLLIN) {
@@ -332,10 +504,33 @@ STATIC void PancakeLinuxPollWait() {
 			}
 		}
 
+		// Edge-triggered sockets that were not drained in previous iterations
+		if(numReady) {
+			UInt32 j;
+
+			for(j = 0; j < numReady; j++) {
+				PancakeSocket *sock = readySockets[j];
+
+				// Socket has been closed or removed meanwhile
+				if(!sock) {
+					continue;
+				}
+
+				readySockets[j] = NULL;
+				sock->flags ^= PANCAKE_LINUX_POLL_QUEUED;
+
+				PancakeLinuxPollEdgeTriggeredDispatch(sock);
+			}
+
+			// Move sockets queued meanwhile to the front
+			memmove(readySockets, readySockets + numReady, (numReadySockets - numReady) * sizeof(PancakeSocket*));
+			numReadySockets -= numReady;
+		}
+
 		// Scheduler events second
 		PancakeSchedulerRun();
 
-		if(UNEXPECTED(PancakeDoShutdown)) {
+		if(UNEXPECTED(PancakeDoShutdown) && PancakeNetworkDrain()) {
 			return;
 		}
 	}
@@ -12,5 +12,11 @@ extern Int32 PancakeLinuxPollFD;
 #define PANCAKE_LINUX_POLL_SOCKET 	1 << 10
 #define PANCAKE_LINUX_POLL_IN 		1 << 11
 #define PANCAKE_LINUX_POLL_OUT		1 << 12
+#define PANCAKE_LINUX_POLL_EDGE		1 << 13
+#define PANCAKE_LINUX_POLL_QUEUED	1 << 14
+#define PANCAKE_LINUX_POLL_CHANGED	1 << 15
+#define PANCAKE_LINUX_POLL_REGISTERED	1 << 16
+#define PANCAKE_LINUX_POLL_REGISTERED_IN	1 << 17
+#define PANCAKE_LINUX_POLL_REGISTERED_OUT	1 << 18
 
 #endif
@@ -20,7 +20,7 @@ STATIC Int32 PancakeOpenSSLNextProtocolNegotiation(SSL *ssl, const UByte **outpu
 STATIC Int32 PancakeOpenSSLServerNameIndication(SSL *ssl, int *ad, void *arg);
 #endif
 STATIC UByte PancakeOpenSSLAcceptConnection(PancakeSocket **socket, PancakeSocket *parent);
-STATIC Int32 PancakeOpenSSLRead(PancakeSocket *socket, UInt32 maxLength, UByte *buf);
+STATIC Int32 PancakeOpenSSLRead(PancakeSocket *socket, UInt32 maxLength);
 STATIC Int32 PancakeOpenSSLWrite(PancakeSocket *socket);
 STATIC void PancakeOpenSSLClose(PancakeSocket *socket);
 
@@ -33,6 +33,8 @@ static PancakeNetworkLayer PancakeOpenSSLNetworkLayer = {
 	PancakeOpenSSLWrite,
 	PancakeOpenSSLClose,
 
+	sizeof(PancakeOpenSSLSocket),
+
 	NULL
 };
 
@@ -496,7 +498,7 @@ STATIC UByte PancakeOpenSSLAcceptConnection(PancakeSocket **socket, PancakeSocke
 	PancakeOpenSSLServerSocket *server = (PancakeOpenSSLServerSocket*) parent;
 	PancakeNetworkTLSApplicationProtocol *protocol;
 
-	sock = PancakeReallocate(sock, sizeof(PancakeOpenSSLSocket));
+	// Sockets are already large enough to hold PancakeOpenSSLSocket
 	sock->session = SSL_new(server->defaultContext);
 	sock->previousHandler = NULL;
 
@@ -527,11 +529,11 @@ STATIC UByte PancakeOpenSSLAcceptConnection(PancakeSocket **socket, PancakeSocke
 	return 1;
 }
 
-STATIC Int32 PancakeOpenSSLRead(PancakeSocket *socket, UInt32 maxLength, UByte *buf) {
+STATIC Int32 PancakeOpenSSLRead(PancakeSocket *socket, UInt32 maxLength) {
 	PancakeOpenSSLSocket *sock = (PancakeOpenSSLSocket*) socket;
 	Int32 length;
 
-	length = SSL_read(sock->session, buf, maxLength);
+	length = SSL_read(sock->session, socket->readBuffer.value + socket->readBuffer.length, maxLength);
 
 	if(length > 0) {
 		if(sock->previousHandler) {
@@ -570,7 +572,7 @@ STATIC Int32 PancakeOpenSSLWrite(PancakeSocket *socket) {
 	PancakeOpenSSLSocket *sock = (PancakeOpenSSLSocket*) socket;
 	Int32 length;
 
-	length = SSL_write(sock->session, socket->writeBuffer.value, socket->writeBuffer.length);
+	length = SSL_write(sock->session, socket->writeBuffer.value + socket->writeBuffer.offset, socket->writeBuffer.length - socket->writeBuffer.offset);
 
 	if(length > 0) {
 		if(sock->previousHandler) {
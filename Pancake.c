@@ -5,11 +5,14 @@
 #include "PancakeWorkers.h"
 #include "PancakeNetwork.h"
 #include "PancakeScheduler.h"
+#include "PancakeStatistics.h"
 
 PancakeWorker *PancakeCurrentWorker;
 PancakeWorker **PancakeWorkerRegistry;
 PancakeMainConfigurationStructure PancakeMainConfiguration;
 UByte PancakeDoShutdown = 0;
+UByte PancakeDoReload = 0;
+Byte **PancakeArguments;
 
 /* Forward declarations */
 STATIC void PancakeSignalHandler(Int32 type, siginfo_t *info, void *context);
@@ -43,10 +46,12 @@ Int32 main(Int32 argc, Byte **argv) {
 #endif
 
 	// Initialize global variables
+	PancakeArguments = argv;
 	worker.name.value = "Master";
 	worker.name.length = sizeof("Master") - 1;
 	worker.pid = getpid();
 	worker.isMaster = 1;
+	worker.cpu = -1;
 	PancakeCurrentWorker = &worker;
 
 	// Tell the user we are loading
@@ -62,16 +67,22 @@ Int32 main(Int32 argc, Byte **argv) {
 	PancakeConfigurationAddSetting(group, (String) {"Error", sizeof("Error") - 1}, CONFIG_TYPE_STRING, &PancakeMainConfiguration.errorLog, sizeof(FILE*), (config_value_t) 0, PancakeConfigurationFile);
 
 	group = PancakeConfigurationAddGroup(NULL, (String) {"Workers", sizeof("Workers") - 1}, NULL);
-	PancakeConfigurationAddSetting(group, (String) {"Amount", sizeof("Amount") - 1}, CONFIG_TYPE_INT, &PancakeMainConfiguration.workers, sizeof(Int32), (config_value_t) 2, NULL);
+	PancakeConfigurationAddSetting(group, (String) {"Amount", sizeof("Amount") - 1}, CONFIG_TYPE_ANY, &PancakeMainConfiguration.workers, sizeof(Int32), (config_value_t) 2, PancakeWorkersAmountConfiguration);
+	PancakeConfigurationAddSetting(group, (String) {"MaxAmount", sizeof("MaxAmount") - 1}, CONFIG_TYPE_ANY, &PancakeMainConfiguration.maxWorkers, sizeof(Int32), (config_value_t) 0, PancakeWorkersAmountConfiguration);
 	PancakeConfigurationAddSetting(group, (String) {"User", sizeof("User") - 1}, CONFIG_TYPE_STRING, &PancakeMainConfiguration.user, sizeof(Byte*), (config_value_t) "www-data", NULL);
 	PancakeConfigurationAddSetting(group, (String) {"Group", sizeof("Group") - 1}, CONFIG_TYPE_STRING, &PancakeMainConfiguration.group, sizeof(Byte*), (config_value_t) "www-data", NULL);
 	PancakeConfigurationAddSetting(group, (String) {"ConcurrencyLimit", sizeof("ConcurrencyLimit") - 1}, CONFIG_TYPE_INT, &PancakeMainConfiguration.concurrencyLimit, sizeof(Int32), (config_value_t) 0, NULL);
+	PancakeConfigurationAddSetting(group, (String) {"AcceptBatch", sizeof("AcceptBatch") - 1}, CONFIG_TYPE_INT, &PancakeMainConfiguration.acceptBatch, sizeof(Int32), (config_value_t) 16, NULL);
+	PancakeConfigurationAddSetting(group, (String) {"HeartbeatTimeout", sizeof("HeartbeatTimeout") - 1}, CONFIG_TYPE_INT, &PancakeMainConfiguration.workerHeartbeatTimeout, sizeof(Int32), (config_value_t) 0, NULL);
+	PancakeConfigurationAddSetting(group, (String) {"CPUAffinity", sizeof("CPUAffinity") - 1}, CONFIG_TYPE_STRING, NULL, 0, (config_value_t) "", PancakeWorkersCPUAffinityConfiguration);
 
 	PancakeConfigurationAddSetting(NULL, (String) {"ServerArchitecture", sizeof("ServerArchitecture") - 1}, CONFIG_TYPE_STRING, &PancakeMainConfiguration.serverArchitecture, sizeof(PancakeServerArchitecture*), (config_value_t) 0, PancakeConfigurationServerArchitecture);
+	PancakeConfigurationAddSetting(NULL, (String) {"ShutdownTimeout", sizeof("ShutdownTimeout") - 1}, CONFIG_TYPE_INT, &PancakeMainConfiguration.shutdownTimeout, sizeof(Int32), (config_value_t) 30, NULL);
 
 	group = PancakeConfigurationAddGroup(NULL, (String) {"NetworkBuffering", sizeof("NetworkBuffering") - 1}, NULL);
 	PancakeConfigurationAddSetting(group, (String) {"Max", sizeof("Max") - 1}, CONFIG_TYPE_INT, &PancakeMainConfiguration.networkBufferingMax, sizeof(Int32), (config_value_t) 131072, NULL);
 	PancakeConfigurationAddSetting(group, (String) {"Min", sizeof("Min") - 1}, CONFIG_TYPE_INT, &PancakeMainConfiguration.networkBufferingMin, sizeof(Int32), (config_value_t) 10240, NULL);
+	PancakeConfigurationAddSetting(group, (String) {"HugePages", sizeof("HugePages") - 1}, CONFIG_TYPE_BOOL, &PancakeMainConfiguration.networkBufferingHugePages, sizeof(UByte), (config_value_t) 0, NULL);
 
 	// Initialize modules
 	do {
@@ -133,8 +144,8 @@ Int32 main(Int32 argc, Byte **argv) {
 	}
 
 	// Initialize server architecture
-	if(PancakeMainConfiguration.serverArchitecture->initialize) {
-		PancakeMainConfiguration.serverArchitecture->initialize();
+	if(PancakeMainConfiguration.serverArchitecture->initialize && !PancakeMainConfiguration.serverArchitecture->initialize()) {
+		exit(3);
 	}
 
 	// Activate sockets
@@ -148,6 +159,7 @@ Int32 main(Int32 argc, Byte **argv) {
 	sigaddset(&signalSet, SIGINT);
 	sigaddset(&signalSet, SIGTERM);
 	sigaddset(&signalSet, SIGPIPE);
+	sigaddset(&signalSet, SIGHUP);
 	signalAction.sa_sigaction = PancakeSignalHandler;
 	signalAction.sa_mask = signalSet;
 	signalAction.sa_flags = SA_SIGINFO;
@@ -156,6 +168,15 @@ Int32 main(Int32 argc, Byte **argv) {
 	sigaction(SIGINT, &signalAction, NULL);
 	sigaction(SIGTERM, &signalAction, NULL);
 	sigaction(SIGPIPE, &signalAction, NULL);
+	sigaction(SIGHUP, &signalAction, NULL);
+
+	// Amount of workers is only scaled when MaxAmount exceeds Amount
+	if(PancakeMainConfiguration.maxWorkers < PancakeMainConfiguration.workers || PancakeMainConfiguration.workers <= 0) {
+		PancakeMainConfiguration.maxWorkers = PancakeMainConfiguration.workers;
+	}
+
+	// One statistics slot per possible worker, shared with the master
+	PancakeStatisticsInitialize(PancakeMainConfiguration.workers > 0 ? PancakeMainConfiguration.maxWorkers : 1);
 
 	// Run workers
 	if(PancakeMainConfiguration.workers > 0) {
@@ -163,8 +184,8 @@ Int32 main(Int32 argc, Byte **argv) {
 		UInt16 i;
 
 		// Allocate worker registry
-		PancakeWorkerRegistry = PancakeAllocate(PancakeMainConfiguration.workers * sizeof(PancakeWorker*));
-		memset(PancakeWorkerRegistry, '\0', PancakeMainConfiguration.workers * sizeof(PancakeWorker*));
+		PancakeWorkerRegistry = PancakeAllocate(PancakeMainConfiguration.maxWorkers * sizeof(PancakeWorker*));
+		memset(PancakeWorkerRegistry, '\0', PancakeMainConfiguration.maxWorkers * sizeof(PancakeWorker*));
 
 		PancakeDebug {
 			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Multithreaded mode enabled with %i workers", PancakeMainConfiguration.workers);
@@ -172,12 +193,7 @@ Int32 main(Int32 argc, Byte **argv) {
 
 		// Run workers
 		for(i = 1; i <= PancakeMainConfiguration.workers; i++) {
-			PancakeWorker *worker = PancakeAllocate(sizeof(PancakeWorker));
-
-			worker->name.value = PancakeAllocate(sizeof("Worker #65535"));
-			worker->name.length = sprintf(worker->name.value, "Worker #%i", i);
-			worker->run = PancakeMainConfiguration.serverArchitecture->runServer;
-			worker->isMaster = 0;
+			PancakeWorker *worker = PancakeCreateWorker(i - 1);
 
 			switch(PancakeRunWorker(worker)) {
 				case 0:
@@ -190,11 +206,9 @@ Int32 main(Int32 argc, Byte **argv) {
 					// Add worker to registry
 					PancakeWorkerRegistry[i - 1] = worker;
 
-					// Sleep forever after all workers are started
-					if(i == PancakeMainConfiguration.workers) {
-						do {
-							sleep(3600);
-						} while(!PancakeDoShutdown);
+					// Supervise workers after all of them are started
+					if(i == PancakeMainConfiguration.workers && PancakeSuperviseWorkers() == 2) {
+						goto shutdown;
 					}
 				} break;
 				case 2: {
@@ -209,6 +223,11 @@ Int32 main(Int32 argc, Byte **argv) {
 			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Singlethreaded mode enabled");
 		}
 
+		PancakeStatisticsAttach(0);
+
+		// Let the master we were reloaded from stop its workers
+		PancakeClosePreviousMaster(1);
+
 		// Run server
 		PancakeMainConfiguration.serverArchitecture->runServer();
 	}
@@ -220,20 +239,16 @@ Int32 main(Int32 argc, Byte **argv) {
 	PancakeSchedulerShutdown();
 
 	if(PancakeCurrentWorker->isMaster) {
-		UInt16 i;
-
 		PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Stopping...");
 
-		for(i = 0; i < PancakeMainConfiguration.workers; i++) {
-			PancakeWorker *worker = PancakeWorkerRegistry[i];
-
-			write(worker->masterSocket, PANCAKE_WORKER_GRACEFUL_SHUTDOWN, sizeof(PANCAKE_WORKER_GRACEFUL_SHUTDOWN));
+		if(PancakeMainConfiguration.workers > 0) {
+			PancakeStopWorkers();
 		}
 	}
 
 	// Destroy worker registry
 	if(PancakeMainConfiguration.workers > 0) {
-		for(i = 0; i < PancakeMainConfiguration.workers; i++) {
+		for(i = 0; i < PancakeMainConfiguration.maxWorkers; i++) {
 			PancakeWorker *worker = PancakeWorkerRegistry[i];
 
 			if(worker == NULL) {
@@ -254,6 +269,9 @@ Int32 main(Int32 argc, Byte **argv) {
 	// Unload server architectures
 	PancakeNetworkUnload();
 
+	// Detach from shared statistics
+	PancakeStatisticsShutdown();
+
 	// Call module shutdown hooks
 	i = 0;
 	while(module = PancakeModules[i]) {
@@ -284,16 +302,14 @@ STATIC void PancakeSignalHandler(Int32 type, siginfo_t *info, void *context) {
 		case SIGTERM:
 			PancakeDoShutdown = 1;
 			break;
+		case SIGHUP:
+			// Configuration is reloaded by the supervisor
+			PancakeDoReload = 1;
+			break;
 		case SIGPIPE:
 			return;
 		case SIGCHLD:
-			if(PancakeDoShutdown) {
-				return;
-			}
-
-			PancakeDoShutdown = 1;
-
-			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Worker crashed");
-			break;
+			// Exited workers are reaped by the supervisor
+			return;
 	}
 }
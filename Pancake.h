@@ -31,6 +31,10 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#ifdef HAVE_SYS_MMAN_H
+#	include <sys/mman.h>
+#endif
+
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 
@@ -133,22 +137,31 @@ typedef struct _PancakeMainConfigurationStructure {
 
 	/* Workers */
 	Int32 workers;
+	Int32 maxWorkers;
 	Byte *user;
 	Byte *group;
 	Int32 concurrencyLimit;
+	Int32 acceptBatch;
+	Int32 workerHeartbeatTimeout;
 
 	/* ServerArchitecture */
 	PancakeServerArchitecture *serverArchitecture;
 
+	/* ShutdownTimeout */
+	Int32 shutdownTimeout;
+
 	/* NetworkBuffering */
 	Int32 networkBufferingMax;
 	Int32 networkBufferingMin;
+	UByte networkBufferingHugePages;
 } PancakeMainConfigurationStructure;
 
 extern PancakeModule *PancakeModules[];
 extern PancakeMainConfigurationStructure PancakeMainConfiguration;
 
 extern UByte PancakeDoShutdown;
+extern UByte PancakeDoReload;
+extern Byte **PancakeArguments;
 
 /* Platform-specific functions */
 #ifndef HAVE_ITOA
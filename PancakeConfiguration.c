@@ -74,7 +74,7 @@ STATIC UByte PancakeConfigurationCheckValue(PancakeConfigurationScope *scope, Pa
 			}
 
 			// Check setting type
-			if(setting->type != configSetting->type && configSetting->type != CONFIG_TYPE_ANY) {
+			if(setting->type != configSetting->type && setting->type != CONFIG_TYPE_ANY && configSetting->type != CONFIG_TYPE_ANY) {
 				PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Failed to parse configuration: Bad value for %s: expected %s, got %s in %s on line %i", configSetting->name, configurationTypeNames[setting->type], configurationTypeNames[configSetting->type], configSetting->file, configSetting->line);
 
 				return 0;
@@ -548,6 +548,9 @@ UByte PancakeConfigurationFile(UByte step, config_setting_t *setting, PancakeCon
 				return 0;
 			}
 
+			// Master opens the file again after reloading
+			fcntl(fileno(stream), F_SETFD, FD_CLOEXEC);
+
 			// Set special type
 			setting->type = CONFIG_TYPE_FILE;
 			free(setting->value.sval);
@@ -8,6 +8,49 @@
 static UByte *RFC1123Days[] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
 static UByte *RFC1123Months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 
+/* Coarse clocks are read from the vDSO without touching the hardware clock source */
+#ifdef CLOCK_REALTIME_COARSE
+# define PANCAKE_CLOCK_REALTIME CLOCK_REALTIME_COARSE
+#else
+# define PANCAKE_CLOCK_REALTIME CLOCK_REALTIME
+#endif
+
+#ifdef CLOCK_MONOTONIC_COARSE
+# define PANCAKE_CLOCK_MONOTONIC CLOCK_MONOTONIC_COARSE
+#else
+# define PANCAKE_CLOCK_MONOTONIC CLOCK_MONOTONIC
+#endif
+
+static UNative clockTime = 0;
+static UInt64 clockMilliseconds = 0;
+
+PANCAKE_API void PancakeUpdateNow() {
+	struct timespec now;
+
+	clock_gettime(PANCAKE_CLOCK_REALTIME, &now);
+	clockTime = now.tv_sec;
+
+	clock_gettime(PANCAKE_CLOCK_MONOTONIC, &now);
+	clockMilliseconds = (UInt64) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+PANCAKE_API inline UNative PancakeNow() {
+	// Clock is read on first use before the server architecture drives it
+	if(UNEXPECTED(!clockTime)) {
+		PancakeUpdateNow();
+	}
+
+	return clockTime;
+}
+
+PANCAKE_API inline UInt64 PancakeNowMilliseconds() {
+	if(UNEXPECTED(!clockTime)) {
+		PancakeUpdateNow();
+	}
+
+	return clockMilliseconds;
+}
+
 PANCAKE_API String PancakeFormatDate(Native time) {
 	struct tm *timeStruct = localtime(&time);
 	String formatted;
@@ -44,9 +87,7 @@ PANCAKE_API void PancakeRFC1123CurrentDate(UByte *buf) {
 	struct tm *now;
 	static Native cachedTime = 0;
 	static UByte cache[29];
-	Native currentTime;
-
-	currentTime = time(NULL);
+	Native currentTime = PancakeNow();
 
 	if(cachedTime == currentTime) {
 		// Cached timestamp equals current timestamp, copy from cache
@@ -4,6 +4,11 @@
 
 #include "Pancake.h"
 
+/* Clock cached per event loop iteration */
+PANCAKE_API void PancakeUpdateNow();
+PANCAKE_API UNative PancakeNow(); /* same as time() */
+PANCAKE_API UInt64 PancakeNowMilliseconds(); /* milliseconds of monotonic clock */
+
 PANCAKE_API String PancakeFormatDate(Native time);
 PANCAKE_API String PancakeFormatDateTime(Native time);
 PANCAKE_API void PancakeRFC1123Date(Native time, UByte *buf);
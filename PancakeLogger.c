@@ -15,8 +15,12 @@ PANCAKE_API void PancakeLogger(UByte type, UByte flags, String *text) {
 	PancakeAssert(text->value != NULL);
 	PancakeAssert(type & PANCAKE_LOGGER_TYPE_MASK);
 
-	/* Fetch current timestamp */
-	date = PancakeFormatDateTime(time(NULL));
+	/* Fetch current timestamp, the master process doesn't run an event loop refreshing the clock */
+	if(PancakeCurrentWorker->isMaster) {
+		PancakeUpdateNow();
+	}
+
+	date = PancakeFormatDateTime(PancakeNow());
 
 	/* 5 = []__\n */
 	output.length = PancakeCurrentWorker->name.length + date.length + text->length + (type == PANCAKE_LOGGER_ERROR ? sizeof("Error:") + 5 : 5);
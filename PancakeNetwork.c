@@ -2,12 +2,410 @@
 #include "PancakeConfiguration.h"
 #include "PancakeLogger.h"
 #include "PancakeWorkers.h"
+#include "PancakePool.h"
+#include "PancakeScheduler.h"
+#include "PancakeDateTime.h"
+#include "PancakeStatistics.h"
+
+typedef struct _PancakeNetworkConnectionCacheEntry {
+	PancakeSocket *socket;
+	PancakeNetworkConnectionCache *cache;
+	PancakeSchedulerEvent *idleTimeout;
+
+	UByte idle;
+
+	/* Requests sharing a kept connection, it only times out or gets evicted without any */
+	UInt32 requests;
+
+	struct _PancakeNetworkConnectionCacheEntry *prev;
+	struct _PancakeNetworkConnectionCacheEntry *next;
+
+	UT_hash_handle hh;
+} PancakeNetworkConnectionCacheEntry;
+
+typedef struct _PancakeNetworkListenSocketOptions {
+	PancakeSocket *socket;
+	PancakeNetworkSocketOptions options;
+
+	UT_hash_handle hh;
+} PancakeNetworkListenSocketOptions;
+
+typedef struct _PancakeNetworkBufferClass {
+	UByte *freeBuffers;
+	UInt32 numFree;
+} PancakeNetworkBufferClass;
+
+typedef struct _PancakeNetworkBufferChunk {
+	UByte *memory;
+	UByte mapped;
+
+	struct _PancakeNetworkBufferChunk *next;
+} PancakeNetworkBufferChunk;
+
+typedef struct _PancakeNetworkConnectState {
+	PancakeSocket *socket;
+	PancakeNetworkConnectCallback callback;
+	PancakeSchedulerEvent *timeout;
+
+	/* Handlers of the socket, restored when the connection is established */
+	PancakeNetworkEventHandler onRead;
+	PancakeNetworkEventHandler onWrite;
+	PancakeNetworkEventHandler onRemoteHangup;
+
+	UT_hash_handle hh;
+} PancakeNetworkConnectState;
 
 static PancakeServerArchitecture *architectures = NULL;
 static PancakeSocket **listenSockets = NULL;
 static PancakeNetworkLayer *networkLayers = NULL;
 static UInt16 numListenSockets = 0;
 
+/* Pools for connection sockets and connection cache entries */
+static PancakePool socketPool = PancakePoolInitializer(sizeof(PancakeSocket), 64);
+static PancakePool connectionCachePool = PancakePoolInitializer(sizeof(PancakeNetworkConnectionCacheEntry), 32);
+
+/* Sockets belonging to a connection cache, for O(1) removal */
+static PancakeNetworkConnectionCacheEntry *cachedConnections = NULL;
+
+/* Socket options of listen interfaces, applied when the sockets start listening */
+static PancakeNetworkListenSocketOptions *listenSocketOptions = NULL;
+
+/* Sockets waiting for their connection to be established */
+static PancakeNetworkConnectState *connectStates = NULL;
+
+/* Network buffers of this worker, sorted into power of two size classes */
+static PancakeNetworkBufferClass *bufferClasses = NULL;
+static UByte numBufferClasses = 0;
+static UInt32 maxBufferClassSize = 0;
+
+/* Chunks buffers are carved from when using huge pages */
+static PancakeNetworkBufferChunk *bufferChunks = NULL;
+static UByte *bufferChunkOffset = NULL;
+static UByte *bufferChunkEnd = NULL;
+
+/* Accepted connections of this worker, for Workers.ConcurrencyLimit */
+static UInt32 numClientConnections = 0;
+static UInt32 numIdleClientConnections = 0;
+static UByte listenSocketsPaused = 0;
+
+/* Listen sockets inherited from the master we were reloaded from */
+static Int32 *inheritedSockets = NULL;
+static UInt16 numInheritedSockets = 0;
+static UByte inheritedSocketsLoaded = 0;
+
+/* Graceful shutdown, see ShutdownTimeout */
+static UByte draining = 0;
+
+/* Connections queued on closing listen sockets are accepted regardless of the concurrency limit */
+static UByte acceptingPending = 0;
+static UByte drainTimedOut = 0;
+
+static UNative numBytesRead = 0;
+static UNative numReadBufferGrowths = 0;
+static UNative numReadBufferBytesMoved = 0;
+static UNative numBufferAllocations = 0;
+static UNative numBufferReuses = 0;
+
+STATIC UByte PancakeNetworkSetSocketOption(Int32 fd, Int32 level, Int32 name, Int32 value, const char *optionName) {
+	if(setsockopt(fd, level, name, &value, sizeof(Int32)) == -1) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't set %s: %s", optionName, strerror(errno));
+		return 0;
+	}
+
+	return 1;
+}
+
+PANCAKE_API UByte PancakeNetworkApplySocketOptions(Int32 fd, sa_family_t family, PancakeNetworkSocketOptions *options, UByte mode) {
+	if(options->sendBuffer && !PancakeNetworkSetSocketOption(fd, SOL_SOCKET, SO_SNDBUF, options->sendBuffer, "SO_SNDBUF")) {
+		return 0;
+	}
+
+	if(options->receiveBuffer && !PancakeNetworkSetSocketOption(fd, SOL_SOCKET, SO_RCVBUF, options->receiveBuffer, "SO_RCVBUF")) {
+		return 0;
+	}
+
+	// Remaining options are TCP only
+	if(family == AF_UNIX) {
+		return 1;
+	}
+
+	if(options->noDelay && !PancakeNetworkSetSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY")) {
+		return 0;
+	}
+
+	if(options->keepAlive) {
+		if(!PancakeNetworkSetSocketOption(fd, SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE")) {
+			return 0;
+		}
+
+#if defined(TCP_KEEPIDLE)
+		if(!PancakeNetworkSetSocketOption(fd, IPPROTO_TCP, TCP_KEEPIDLE, options->keepAlive, "TCP_KEEPIDLE")) {
+			return 0;
+		}
+#elif defined(TCP_KEEPALIVE)
+		if(!PancakeNetworkSetSocketOption(fd, IPPROTO_TCP, TCP_KEEPALIVE, options->keepAlive, "TCP_KEEPALIVE")) {
+			return 0;
+		}
+#endif
+	}
+
+#ifdef TCP_NOTSENT_LOWAT
+	if(options->notSentLowWatermark && !PancakeNetworkSetSocketOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, options->notSentLowWatermark, "TCP_NOTSENT_LOWAT")) {
+		return 0;
+	}
+#endif
+
+	if(mode == PANCAKE_NETWORK_SOCKET_OPTIONS_LISTEN) {
+#ifdef TCP_DEFER_ACCEPT
+		if(options->deferAccept && !PancakeNetworkSetSocketOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, options->deferAccept, "TCP_DEFER_ACCEPT")) {
+			return 0;
+		}
+#endif
+#ifdef TCP_FASTOPEN
+		if(options->fastOpen && !PancakeNetworkSetSocketOption(fd, IPPROTO_TCP, TCP_FASTOPEN, options->fastOpen, "TCP_FASTOPEN")) {
+			return 0;
+		}
+#endif
+	} else {
+#ifdef TCP_FASTOPEN_CONNECT
+		if(options->fastOpen && !PancakeNetworkSetSocketOption(fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, 1, "TCP_FASTOPEN_CONNECT")) {
+			return 0;
+		}
+#endif
+	}
+
+	return 1;
+}
+
+STATIC UByte PancakeNetworkApplyListenSocketOptions(PancakeSocket *sock, Int32 fd) {
+	PancakeNetworkListenSocketOptions *options;
+
+	HASH_FIND_PTR(listenSocketOptions, &sock, options);
+
+	// Accepted sockets inherit these options from the listen socket
+	return options == NULL || PancakeNetworkApplySocketOptions(fd, sock->localAddress->sa_family, &options->options, PANCAKE_NETWORK_SOCKET_OPTIONS_LISTEN);
+}
+
+STATIC void PancakeNetworkInitializeBufferPool() {
+	maxBufferClassSize = PANCAKE_NETWORK_BUFFER_MIN;
+	numBufferClasses = 1;
+
+	while(maxBufferClassSize < (UInt32) PancakeMainConfiguration.networkBufferingMax) {
+		maxBufferClassSize *= 2;
+		numBufferClasses++;
+	}
+
+	bufferClasses = PancakeAllocate(numBufferClasses * sizeof(PancakeNetworkBufferClass));
+	memset(bufferClasses, 0, numBufferClasses * sizeof(PancakeNetworkBufferClass));
+}
+
+STATIC void PancakeNetworkLoadInheritedSockets() {
+	Byte *value = getenv(PANCAKE_NETWORK_LISTEN_SOCKETS_ENV);
+
+	inheritedSocketsLoaded = 1;
+
+	if(value == NULL) {
+		return;
+	}
+
+	// Comma-separated list of file descriptors
+	while(*value) {
+		Byte *end;
+		Int32 fd = strtol(value, &end, 10);
+
+		if(end == value) {
+			break;
+		}
+
+		inheritedSockets = PancakeReallocate(inheritedSockets, (numInheritedSockets + 1) * sizeof(Int32));
+		inheritedSockets[numInheritedSockets++] = fd;
+
+		value = *end == ',' ? end + 1 : end;
+	}
+}
+
+STATIC UByte PancakeNetworkIsSameAddress(struct sockaddr *a, struct sockaddr *b) {
+	if(a->sa_family != b->sa_family) {
+		return 0;
+	}
+
+	switch(a->sa_family) {
+		case AF_INET:
+			return ((struct sockaddr_in*) a)->sin_port == ((struct sockaddr_in*) b)->sin_port
+				&& ((struct sockaddr_in*) a)->sin_addr.s_addr == ((struct sockaddr_in*) b)->sin_addr.s_addr;
+		case AF_INET6:
+			return ((struct sockaddr_in6*) a)->sin6_port == ((struct sockaddr_in6*) b)->sin6_port
+				&& !memcmp(&((struct sockaddr_in6*) a)->sin6_addr, &((struct sockaddr_in6*) b)->sin6_addr, sizeof(struct in6_addr));
+		case AF_UNIX:
+			return !strcmp(((struct sockaddr_un*) a)->sun_path, ((struct sockaddr_un*) b)->sun_path);
+	}
+
+	return 0;
+}
+
+STATIC Int32 PancakeNetworkTakeInheritedSocket(struct sockaddr *address) {
+	UInt16 i;
+
+	if(!inheritedSocketsLoaded) {
+		PancakeNetworkLoadInheritedSockets();
+	}
+
+	for(i = 0; i < numInheritedSockets; i++) {
+		struct sockaddr_storage inherited;
+		socklen_t length = sizeof(inherited);
+		Int32 fd = inheritedSockets[i];
+
+		if(getsockname(fd, (struct sockaddr*) &inherited, &length) == -1
+		|| !PancakeNetworkIsSameAddress((struct sockaddr*) &inherited, address)) {
+			continue;
+		}
+
+		inheritedSockets[i] = inheritedSockets[--numInheritedSockets];
+		return fd;
+	}
+
+	return -1;
+}
+
+PANCAKE_API void PancakeNetworkExportListenSockets() {
+	Byte *value = PancakeAllocate(numListenSockets * 12 + 1), *offset = value;
+	UInt16 i;
+
+	*offset = '\0';
+
+	for(i = 0; i < numListenSockets; i++) {
+		if(listenSockets[i]->fd == -1) {
+			continue;
+		}
+
+		offset += sprintf(offset, offset == value ? "%i" : ",%i", listenSockets[i]->fd);
+	}
+
+	setenv(PANCAKE_NETWORK_LISTEN_SOCKETS_ENV, value, 1);
+	PancakeFree(value);
+}
+
+STATIC UByte PancakeNetworkHasAcceptMode(PancakeSocket *sock, Int32 fd) {
+	Int32 listening = 0, reusePort = 0;
+	socklen_t length;
+
+	// Masters only listen on shared sockets, workers open their own reuseport sockets
+#ifdef SO_ACCEPTCONN
+	length = sizeof(Int32);
+
+	if(getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &listening, &length) == -1
+	|| !listening != !!(sock->flags & PANCAKE_NETWORK_ACCEPT_REUSEPORT)) {
+		return 0;
+	}
+#endif
+
+#ifdef SO_REUSEPORT
+	length = sizeof(Int32);
+
+	if(getsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &reusePort, &length) == -1) {
+		return 0;
+	}
+#endif
+
+	return !reusePort == !(sock->flags & PANCAKE_NETWORK_ACCEPT_REUSEPORT);
+}
+
+STATIC UByte PancakeNetworkInterfaceTryBind(PancakeSocket *socket) {
+	Int32 fd;
+	int retval;
+
+	switch(socket->localAddress->sa_family) {
+		case AF_INET:
+			if(!((struct sockaddr_in*) socket->localAddress)->sin_port) {
+				PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "No port set for IPv4 interface");
+				return 0;
+			}
+			break;
+		case AF_INET6:
+			if(!((struct sockaddr_in6*) socket->localAddress)->sin6_port) {
+				PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "No port set for IPv6 interface");
+				return 0;
+			}
+			break;
+		case AF_UNIX:
+			if(!((struct sockaddr_un*) socket->localAddress)->sun_path[0]) {
+				PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "No address set for UNIX interface");
+				return 0;
+			}
+
+			if(socket->flags & PANCAKE_NETWORK_ACCEPT_REUSEPORT) {
+				PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Accept mode reuseport is not supported on UNIX sockets");
+				return 0;
+			}
+			break;
+	}
+
+	// Keep the socket of the master we were reloaded from so that no connection is refused
+	if((fd = PancakeNetworkTakeInheritedSocket(socket->localAddress)) != -1) {
+		close(socket->fd);
+		socket->fd = fd;
+
+		// Binding a new socket with another accept mode fails while the previous workers still use this one
+		if(!PancakeNetworkHasAcceptMode(socket, fd)) {
+			Byte *name = PancakeNetworkGetInterfaceName(socket->localAddress);
+
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Accept mode of interface %s can't be changed by reloading, restart instead", name);
+			PancakeFree(name);
+
+			return 0;
+		}
+
+		return 1;
+	}
+
+#ifdef SO_REUSEPORT
+	// Workers bind their own sockets to the same address, which requires SO_REUSEPORT on all of them
+	if((socket->flags & PANCAKE_NETWORK_ACCEPT_REUSEPORT)
+	&& !PancakeNetworkSetSocketOption(socket->fd, SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT")) {
+		return 0;
+	}
+#endif
+
+	// Try binding to interface
+	switch(socket->localAddress->sa_family) {
+		case AF_INET:
+			retval = bind(socket->fd, socket->localAddress, sizeof(struct sockaddr_in));
+			break;
+		case AF_INET6:
+			retval = bind(socket->fd, socket->localAddress, sizeof(struct sockaddr_in6));
+			break;
+		case AF_UNIX:
+			retval = bind(socket->fd, socket->localAddress, SUN_LEN((struct sockaddr_un*) socket->localAddress));
+			break;
+	}
+
+	if(retval == -1) {
+		Byte *name = PancakeNetworkGetInterfaceName(socket->localAddress);
+
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't bind to interface %s: %s", name, strerror(errno));
+		PancakeFree(name);
+
+		return 0;
+	}
+
+	socket->flags |= PANCAKE_NETWORK_BOUND;
+
+	return 1;
+}
+
+STATIC void PancakeNetworkUnbindListenSockets() {
+	UInt16 i;
+
+	// Socket files left behind would make binding fail the next time
+	for(i = 0; i < numListenSockets; i++) {
+		PancakeSocket *sock = listenSockets[i];
+
+		if(sock->localAddress->sa_family == AF_UNIX && (sock->flags & PANCAKE_NETWORK_BOUND)) {
+			unlink(((struct sockaddr_un*) sock->localAddress)->sun_path);
+		}
+	}
+}
+
 UByte PancakeNetworkActivate() {
 	UInt16 i;
 
@@ -16,16 +414,46 @@ UByte PancakeNetworkActivate() {
 		return 0;
 	}
 
+	// Interfaces are bound once all of their settings are known
+	for(i = 0; i < numListenSockets; i++) {
+		if(!PancakeNetworkInterfaceTryBind(listenSockets[i])) {
+			PancakeNetworkUnbindListenSockets();
+			return 0;
+		}
+	}
+
+	// Interfaces removed from the configuration while reloading
+	while(numInheritedSockets) {
+		close(inheritedSockets[--numInheritedSockets]);
+	}
+
+	if(inheritedSockets) {
+		PancakeFree(inheritedSockets);
+		inheritedSockets = NULL;
+	}
+
+	unsetenv(PANCAKE_NETWORK_LISTEN_SOCKETS_ENV);
+
+	// Workers inherit the empty pool
+	PancakeNetworkInitializeBufferPool();
+
 	for(i = 0; i < numListenSockets; i++) {
 		PancakeSocket *sock = listenSockets[i];
 
+		// Workers open their own listening sockets, keep backlog for them
+		if(sock->flags & PANCAKE_NETWORK_ACCEPT_REUSEPORT) {
+			continue;
+		}
+
 		// Start listening on socket
-		if(listen(sock->fd, (Int32) (UNative) sock->data) == -1) {
+		if(!PancakeNetworkApplyListenSocketOptions(sock, sock->fd)
+		|| listen(sock->fd, (Int32) (UNative) sock->data) == -1) {
 			Byte *name = PancakeNetworkGetInterfaceName(sock->localAddress);
 
 			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't listen on %s: %s", name, strerror(errno));
 
 			PancakeFree(name);
+			PancakeNetworkUnbindListenSockets();
 			return 0;
 		}
 
@@ -35,17 +463,175 @@ UByte PancakeNetworkActivate() {
 	return 1;
 }
 
+STATIC UByte PancakeNetworkOpenReusePortSocket(PancakeSocket *sock) {
+#ifdef SO_REUSEPORT
+	Int32 fd, value = 1;
+	socklen_t length = sock->localAddress->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+
+	fd = socket(sock->localAddress->sa_family, SOCK_STREAM, SOL_TCP);
+
+	if(fd == -1) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't create socket: %s", strerror(errno));
+		return 0;
+	}
+
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(Int32));
+	setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &value, sizeof(Int32));
+
+	if(!PancakeNetworkApplyListenSocketOptions(sock, fd)) {
+		close(fd);
+		return 0;
+	}
+
+#ifdef SO_INCOMING_CPU
+	// Let the kernel hand connections processed on the CPU of this worker to its own socket
+	if(PancakeCurrentWorker->cpu != -1) {
+		setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &PancakeCurrentWorker->cpu, sizeof(Int32));
+	}
+#endif
+
+	// Bind to the address already reserved by the master
+	if(bind(fd, sock->localAddress, length) == -1
+	|| listen(fd, (Int32) (UNative) sock->data) == -1) {
+		Byte *name = PancakeNetworkGetInterfaceName(sock->localAddress);
+
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't listen on %s: %s", name, strerror(errno));
+		PancakeFree(name);
+
+		close(fd);
+		return 0;
+	}
+
+	// Replace the inherited socket, which is bound but not listening
+	close(sock->fd);
+	sock->fd = fd;
+	sock->data = NULL;
+
+	return 1;
+#else
+	return 0;
+#endif
+}
+
 PANCAKE_API void PancakeNetworkActivateListenSockets() {
 	UInt16 i;
 
 	for(i = 0; i < numListenSockets; i++) {
 		PancakeSocket *sock = listenSockets[i];
 
+		// Open a socket owned by this worker
+		if((sock->flags & PANCAKE_NETWORK_ACCEPT_REUSEPORT) && !PancakeNetworkOpenReusePortSocket(sock)) {
+			continue;
+		}
+
 		// Add socket to read socket list
 		PancakeNetworkAddReadSocket(sock);
 	}
 }
 
+STATIC void PancakeNetworkSetListenSocketsPaused(UByte paused) {
+	UInt16 i;
+
+	listenSocketsPaused = paused;
+
+	for(i = 0; i < numListenSockets; i++) {
+		PancakeSocket *sock = listenSockets[i];
+
+		// Listen socket could not be activated in this worker
+		if(sock->data != NULL) {
+			continue;
+		}
+
+		if(paused) {
+			PancakeNetworkRemoveReadSocket(sock);
+		} else {
+			PancakeNetworkAddReadSocket(sock);
+		}
+	}
+}
+
+STATIC void PancakeNetworkOnDrainTimeout(void *arg) {
+	drainTimedOut = 1;
+}
+
+STATIC void PancakeNetworkAcceptPendingConnections(PancakeSocket *sock) {
+	Int32 flags = fcntl(sock->fd, F_GETFL);
+
+	// Stop at an empty queue instead of waiting for the next connection
+	fcntl(sock->fd, F_SETFL, flags | O_NONBLOCK);
+	acceptingPending = 1;
+
+	do {
+		sock->flags |= PANCAKE_NETWORK_READABLE;
+		sock->onRead(sock);
+	} while(sock->flags & PANCAKE_NETWORK_READABLE);
+
+	acceptingPending = 0;
+}
+
+PANCAKE_API UByte PancakeNetworkDrain() {
+	if(!draining) {
+		UInt16 i;
+
+		draining = 1;
+
+		// Leave new connections to the server replacing us
+		for(i = 0; i < numListenSockets; i++) {
+			PancakeSocket *sock = listenSockets[i];
+
+			// Listen socket could not be activated in this worker
+			if(sock->data != NULL) {
+				continue;
+			}
+
+			// Sockets of this worker are closed so that the kernel stops handing connections to it
+			if(sock->flags & PANCAKE_NETWORK_ACCEPT_REUSEPORT) {
+				// Closing drops the connections still queued on the socket
+				PancakeNetworkAcceptPendingConnections(sock);
+
+				PancakeMainConfiguration.serverArchitecture->onSocketClose(sock);
+
+				close(sock->fd);
+				sock->fd = -1;
+			} else if(!listenSocketsPaused) {
+				PancakeNetworkRemoveReadSocket(sock);
+			}
+		}
+
+		listenSocketsPaused = 1;
+
+		if(PancakeMainConfiguration.shutdownTimeout > 0) {
+			PancakeScheduleIn(PancakeMainConfiguration.shutdownTimeout * 1000, PancakeNetworkOnDrainTimeout, NULL);
+		}
+	}
+
+	// Idle connections are closed by their timeouts when the scheduler shuts down
+	if(numClientConnections <= numIdleClientConnections) {
+		return 1;
+	}
+
+	if(drainTimedOut || PancakeMainConfiguration.shutdownTimeout <= 0) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Shutdown timeout reached, dropping %u active connections", numClientConnections - numIdleClientConnections);
+		return 1;
+	}
+
+	return 0;
+}
+
+PANCAKE_API void PancakeNetworkSetIdle(PancakeSocket *sock, UByte idle) {
+	if(idle == !!(sock->flags & PANCAKE_NETWORK_IDLE)) {
+		return;
+	}
+
+	if(idle) {
+		sock->flags |= PANCAKE_NETWORK_IDLE;
+		numIdleClientConnections++;
+	} else {
+		sock->flags &= ~(PANCAKE_NETWORK_IDLE);
+		numIdleClientConnections--;
+	}
+}
+
 PANCAKE_API Byte *PancakeNetworkGetInterfaceName(struct sockaddr *addr) {
 	Byte *name;
 
@@ -86,11 +672,73 @@ PANCAKE_API void PancakeRegisterServerArchitecture(PancakeServerArchitecture *ar
 
 PANCAKE_API void PancakeNetworkRegisterNetworkLayer(PancakeNetworkLayer *layer) {
 	LL_APPEND(networkLayers, layer);
+
+	// Sockets are extended in place by network layers
+	PancakePoolSetObjectSize(&socketPool, layer->socketSize);
+}
+
+STATIC void PancakeNetworkDestroyBufferPool() {
+	PancakeNetworkBufferChunk *chunk, *tmp;
+	UInt32 classSize = PANCAKE_NETWORK_BUFFER_MIN;
+	UByte i;
+
+	for(i = 0; i < numBufferClasses; i++, classSize *= 2) {
+		// Buffers carved from chunks are freed with their chunk
+		if(bufferChunks && classSize <= PANCAKE_NETWORK_BUFFER_CHUNK_SIZE) {
+			continue;
+		}
+
+		while(bufferClasses[i].freeBuffers) {
+			UByte *buffer = bufferClasses[i].freeBuffers;
+
+			bufferClasses[i].freeBuffers = *((UByte**) buffer);
+			PancakeFree(buffer);
+		}
+	}
+
+	LL_FOREACH_SAFE(bufferChunks, chunk, tmp) {
+#ifdef HAVE_SYS_MMAN_H
+		if(chunk->mapped) {
+			munmap(chunk->memory, PANCAKE_NETWORK_BUFFER_CHUNK_SIZE);
+		} else
+#endif
+		{
+			PancakeFree(chunk->memory);
+		}
+
+		PancakeFree(chunk);
+	}
+
+	if(bufferClasses) {
+		PancakeFree(bufferClasses);
+	}
+
+	bufferChunks = NULL;
+	bufferClasses = NULL;
+	numBufferClasses = 0;
 }
 
 void PancakeNetworkUnload() {
+	PancakeDebug {
+		if(numBytesRead) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Network: %lu bytes read, %lu read buffer growths moving at most %lu bytes",
+					(unsigned long) numBytesRead, (unsigned long) numReadBufferGrowths, (unsigned long) numReadBufferBytesMoved);
+		}
+	}
+
+	PancakeDebug {
+		if(numBufferAllocations) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Network: %lu buffers allocated, %lu reused from pool",
+					(unsigned long) numBufferAllocations, (unsigned long) numBufferReuses);
+		}
+	}
+
 	PancakeFree(listenSockets);
 
+	PancakeNetworkDestroyBufferPool();
+	PancakePoolDestroy(&socketPool);
+	PancakePoolDestroy(&connectionCachePool);
+
 	HASH_CLEAR(hh, architectures);
 }
 
@@ -106,7 +754,7 @@ PANCAKE_API UByte PancakeNetworkInterfaceConfiguration(UByte step, config_settin
 			socket->onRead = NULL;
 			socket->onWrite = NULL;
 			socket->onRemoteHangup = NULL;
-			socket->flags = 0;
+			socket->flags = PANCAKE_NETWORK_LISTEN;
 			socket->layer = NULL;
 
 			socket->localAddress->sa_family = 0;
@@ -116,6 +764,14 @@ PANCAKE_API UByte PancakeNetworkInterfaceConfiguration(UByte step, config_settin
 		} break;
 		case PANCAKE_CONFIGURATION_DTOR: {
 			PancakeSocket *socket = (PancakeSocket*) setting->hook;
+			PancakeNetworkListenSocketOptions *options;
+
+			HASH_FIND_PTR(listenSocketOptions, &socket, options);
+
+			if(options) {
+				HASH_DEL(listenSocketOptions, options);
+				PancakeFree(options);
+			}
 
 			if(socket->fd != -1) {
 				close(socket->fd);
@@ -167,14 +823,28 @@ STATIC UByte PancakeNetworkInterfaceNetworkConfiguration(UByte step, config_sett
 
 		// Set SO_REUSEADDR
 		setsockopt(sock->fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(Int32));
+
+		// Add socket for later binding and activation
+		numListenSockets++;
+		listenSockets = PancakeReallocate(listenSockets, numListenSockets * sizeof(PancakeSocket*));
+		listenSockets[numListenSockets - 1] = sock;
 	}
 
 	return 1;
 }
 
 PANCAKE_API void PancakeNetworkReplaceListenSocket(PancakeSocket *previous, PancakeSocket *new) {
+	PancakeNetworkListenSocketOptions *options;
 	UInt16 i = 0;
 
+	HASH_FIND_PTR(listenSocketOptions, &previous, options);
+
+	if(options) {
+		HASH_DEL(listenSocketOptions, options);
+		options->socket = new;
+		HASH_ADD_PTR(listenSocketOptions, socket, options);
+	}
+
 	for(; i < numListenSockets; i++) {
 		if(listenSockets[i] == previous) {
 			listenSockets[i] = new;
@@ -183,39 +853,6 @@ PANCAKE_API void PancakeNetworkReplaceListenSocket(PancakeSocket *previous, Panc
 	}
 }
 
-STATIC UByte PancakeNetworkInterfaceTryBind(PancakeSocket *socket) {
-	int retval;
-
-	// Try binding to interface
-	switch(socket->localAddress->sa_family) {
-		case AF_INET:
-			retval = bind(socket->fd, socket->localAddress, sizeof(struct sockaddr_in));
-			break;
-		case AF_INET6:
-			retval = bind(socket->fd, socket->localAddress, sizeof(struct sockaddr_in6));
-			break;
-		case AF_UNIX:
-			retval = bind(socket->fd, socket->localAddress, SUN_LEN((struct sockaddr_un*) socket->localAddress));
-			break;
-	}
-
-	if(retval == -1) {
-		Byte *name = PancakeNetworkGetInterfaceName(socket->localAddress);
-
-		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't bind to interface %s: %s", name, strerror(errno));
-		PancakeFree(name);
-
-		return 0;
-	}
-
-	// Add socket for later activation
-	numListenSockets++;
-	listenSockets = PancakeReallocate(listenSockets, numListenSockets * sizeof(PancakeSocket*));
-	listenSockets[numListenSockets - 1] = socket;
-
-	return 1;
-}
-
 STATIC UByte PancakeNetworkInterfaceAddressConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
 	PancakeSocket *socket;
 
@@ -241,11 +878,6 @@ STATIC UByte PancakeNetworkInterfaceAddressConfiguration(UByte step, config_sett
 							PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Invalid IPv4 address: %s", setting->value.sval);
 							return 0;
 					}
-
-					// Try binding now if address data is complete
-					if(addr->sin_port && !PancakeNetworkInterfaceTryBind(socket)) {
-						return 0;
-					}
 				} break;
 				case AF_INET6: {
 					struct sockaddr_in6 *addr = (struct sockaddr_in6*) socket->localAddress;
@@ -259,11 +891,6 @@ STATIC UByte PancakeNetworkInterfaceAddressConfiguration(UByte step, config_sett
 							PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Invalid IPv6 address: %s", setting->value.sval);
 							return 0;
 					}
-
-					// Try binding now if address data is complete
-					if(addr->sin6_port && !PancakeNetworkInterfaceTryBind(socket)) {
-						return 0;
-					}
 				} break;
 				case AF_UNIX: {
 					struct sockaddr_un *addr = (struct sockaddr_un*) socket->localAddress;
@@ -274,10 +901,6 @@ STATIC UByte PancakeNetworkInterfaceAddressConfiguration(UByte step, config_sett
 					}
 
 					memcpy(addr->sun_path, setting->value.sval, strlen(setting->value.sval) + 1);
-
-					if(!PancakeNetworkInterfaceTryBind(socket)) {
-						return 0;
-					}
 				} break;
 			}
 		} break;
@@ -309,19 +932,11 @@ STATIC UByte PancakeNetworkInterfacePortConfiguration(UByte step, config_setting
 					struct sockaddr_in *addr = (struct sockaddr_in*) socket->localAddress;
 
 					addr->sin_port = htons(setting->value.ival);
-
-					if(addr->sin_addr.s_addr && !PancakeNetworkInterfaceTryBind(socket)) {
-						return 0;
-					}
 				} break;
 				case AF_INET6: {
 					struct sockaddr_in6 *addr = (struct sockaddr_in6*) socket->localAddress;
 
 					addr->sin6_port = htons(setting->value.ival);
-
-					if(addr->sin6_addr.s6_addr && !PancakeNetworkInterfaceTryBind(socket)) {
-						return 0;
-					}
 				} break;
 				case AF_UNIX: {
 					PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't set port on UNIX sockets");
@@ -338,7 +953,99 @@ STATIC UByte PancakeNetworkInterfaceBacklogConfiguration(UByte step, config_sett
 	if(step == PANCAKE_CONFIGURATION_INIT) {
 		PancakeSocket *sock = (PancakeSocket*) setting->parent->hook;
 
-		sock->data = (void*) (UNative) setting->value.ival;
+		sock->data = (void*) (UNative) setting->value.ival;
+	}
+
+	return 1;
+}
+
+STATIC UByte PancakeNetworkInterfaceAcceptModeConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	if(step == PANCAKE_CONFIGURATION_INIT) {
+		PancakeSocket *sock = (PancakeSocket*) setting->parent->hook;
+
+		// SO_REUSEPORT is set when the socket is bound
+		if(!strcmp(setting->value.sval, "shared")) {
+			sock->flags &= ~(PANCAKE_NETWORK_ACCEPT_EXCLUSIVE | PANCAKE_NETWORK_ACCEPT_REUSEPORT);
+		} else if(!strcmp(setting->value.sval, "exclusive")) {
+			sock->flags &= ~(PANCAKE_NETWORK_ACCEPT_REUSEPORT);
+			sock->flags |= PANCAKE_NETWORK_ACCEPT_EXCLUSIVE;
+		} else if(!strcmp(setting->value.sval, "reuseport")) {
+#ifdef SO_REUSEPORT
+			sock->flags &= ~(PANCAKE_NETWORK_ACCEPT_EXCLUSIVE);
+			sock->flags |= PANCAKE_NETWORK_ACCEPT_REUSEPORT;
+#else
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Accept mode reuseport is not supported on this system");
+			return 0;
+#endif
+		} else {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Invalid accept mode %s", setting->value.sval);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+STATIC UByte PancakeNetworkSocketOptionConfiguration(PancakeNetworkSocketOptions *options, config_setting_t *setting) {
+	Int32 value = setting->value.ival;
+
+	if(value < 0) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "%s must not be negative", setting->name);
+		return 0;
+	}
+
+	if(!strcmp(setting->name, "NoDelay")) {
+		options->noDelay = value;
+	} else if(!strcmp(setting->name, "DeferAccept")) {
+#ifdef TCP_DEFER_ACCEPT
+		options->deferAccept = value;
+#else
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "DeferAccept is not supported on this system");
+		return 0;
+#endif
+	} else if(!strcmp(setting->name, "FastOpen")) {
+		options->fastOpen = value;
+	} else if(!strcmp(setting->name, "SendBuffer")) {
+		options->sendBuffer = value;
+	} else if(!strcmp(setting->name, "ReceiveBuffer")) {
+		options->receiveBuffer = value;
+	} else if(!strcmp(setting->name, "NotSentLowWatermark")) {
+#ifdef TCP_NOTSENT_LOWAT
+		options->notSentLowWatermark = value;
+#else
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "NotSentLowWatermark is not supported on this system");
+		return 0;
+#endif
+	} else if(!strcmp(setting->name, "KeepAlive")) {
+		options->keepAlive = value;
+	}
+
+	return 1;
+}
+
+STATIC UByte PancakeNetworkInterfaceSocketOptionConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	if(step == PANCAKE_CONFIGURATION_INIT && setting->value.ival) {
+		PancakeSocket *sock = (PancakeSocket*) setting->parent->hook;
+		PancakeNetworkListenSocketOptions *options;
+
+#ifndef TCP_FASTOPEN
+		if(!strcmp(setting->name, "FastOpen")) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "FastOpen is not supported on this system");
+			return 0;
+		}
+#endif
+
+		HASH_FIND_PTR(listenSocketOptions, &sock, options);
+
+		if(options == NULL) {
+			options = PancakeAllocate(sizeof(PancakeNetworkListenSocketOptions));
+			memset(&options->options, 0, sizeof(PancakeNetworkSocketOptions));
+			options->socket = sock;
+
+			HASH_ADD_PTR(listenSocketOptions, socket, options);
+		}
+
+		return PancakeNetworkSocketOptionConfiguration(&options->options, setting);
 	}
 
 	return 1;
@@ -369,8 +1076,26 @@ STATIC UByte PancakeNetworkInterfaceLayerConfiguration(UByte step, config_settin
 }
 
 PANCAKE_API void PancakeNetworkClientInterfaceConfiguration(PancakeNetworkClientInterface *client) {
-	// Initialize value
+	// Initialize values
 	client->address = NULL;
+	memset(&client->socketOptions, 0, sizeof(PancakeNetworkSocketOptions));
+}
+
+STATIC UByte PancakeNetworkClientInterfaceSocketOptionConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	if(step == PANCAKE_CONFIGURATION_INIT) {
+		PancakeNetworkClientInterface *client = (PancakeNetworkClientInterface*) setting->parent->hook;
+
+#ifndef TCP_FASTOPEN_CONNECT
+		if(setting->value.ival && !strcmp(setting->name, "FastOpen")) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "FastOpen is not supported on this system");
+			return 0;
+		}
+#endif
+
+		return PancakeNetworkSocketOptionConfiguration(&client->socketOptions, setting);
+	}
+
+	return 1;
 }
 
 STATIC UByte PancakeNetworkClientInterfaceNetworkConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
@@ -498,6 +1223,14 @@ PANCAKE_API PancakeConfigurationSetting *PancakeNetworkRegisterListenInterfaceGr
 	PancakeConfigurationAddSetting(group, (String) {"Port", sizeof("Port") - 1}, CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkInterfacePortConfiguration);
 	PancakeConfigurationAddSetting(group, (String) {"Backlog", sizeof("Backlog") - 1}, CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkInterfaceBacklogConfiguration);
 	PancakeConfigurationAddSetting(group, StaticString("NetworkLayer"), CONFIG_TYPE_STRING, NULL, 0, (config_value_t) "", PancakeNetworkInterfaceLayerConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("AcceptMode"), CONFIG_TYPE_STRING, NULL, 0, (config_value_t) "shared", PancakeNetworkInterfaceAcceptModeConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("NoDelay"), CONFIG_TYPE_BOOL, NULL, 0, (config_value_t) 0, PancakeNetworkInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("DeferAccept"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("FastOpen"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("SendBuffer"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("ReceiveBuffer"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("NotSentLowWatermark"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("KeepAlive"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkInterfaceSocketOptionConfiguration);
 
 	LL_FOREACH(networkLayers, layer) {
 		if(layer->configure) {
@@ -517,6 +1250,12 @@ PANCAKE_API PancakeConfigurationGroup *PancakeNetworkRegisterClientInterfaceGrou
 	PancakeConfigurationAddSetting(group, (String) {"Network", sizeof("Network") - 1}, CONFIG_TYPE_STRING, NULL, 0, (config_value_t) "", PancakeNetworkClientInterfaceNetworkConfiguration);
 	PancakeConfigurationAddSetting(group, (String) {"Address", sizeof("Address") - 1}, CONFIG_TYPE_STRING, NULL, 0, (config_value_t) "", PancakeNetworkClientInterfaceAddressConfiguration);
 	PancakeConfigurationAddSetting(group, (String) {"Port", sizeof("Port") - 1}, CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkClientInterfacePortConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("NoDelay"), CONFIG_TYPE_BOOL, NULL, 0, (config_value_t) 0, PancakeNetworkClientInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("FastOpen"), CONFIG_TYPE_BOOL, NULL, 0, (config_value_t) 0, PancakeNetworkClientInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("SendBuffer"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkClientInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("ReceiveBuffer"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkClientInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("NotSentLowWatermark"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkClientInterfaceSocketOptionConfiguration);
+	PancakeConfigurationAddSetting(group, StaticString("KeepAlive"), CONFIG_TYPE_INT, NULL, 0, (config_value_t) 0, PancakeNetworkClientInterfaceSocketOptionConfiguration);
 
 	return group;
 }
@@ -563,14 +1302,28 @@ PANCAKE_API inline PancakeSocket *PancakeNetworkAcceptConnection(PancakeSocket *
 	Int32 flags;
 #endif
 
+	// Worker is at its concurrency limit, leave connections to other workers
+	if(UNEXPECTED(listenSocketsPaused) && !acceptingPending) {
+		return NULL;
+	}
+
+	if(PancakeMainConfiguration.serverArchitecture->acceptConnection) {
+		// Connection has already been accepted by the server architecture
+		fd = PancakeMainConfiguration.serverArchitecture->acceptConnection(sock, &addr);
+	}
+
+	// Connections the server architecture has not taken yet are still queued in the kernel
+	if(!PancakeMainConfiguration.serverArchitecture->acceptConnection || (fd == -1 && acceptingPending)) {
 #ifdef HAVE_ACCEPT4
-	// Accelerated version for Linux
-	fd = accept4(sock->fd, &addr, &addrLen, SOCK_NONBLOCK);
+		// Accelerated version for Linux
+		fd = accept4(sock->fd, &addr, &addrLen, SOCK_NONBLOCK);
 #else
-	fd = accept(sock->fd, &addr, &addrLen);
+		fd = accept(sock->fd, &addr, &addrLen);
 #endif
+	}
 
 	if(fd == -1) {
+		sock->flags &= ~(PANCAKE_NETWORK_READABLE);
 		return NULL;
 	}
 
@@ -580,7 +1333,7 @@ PANCAKE_API inline PancakeSocket *PancakeNetworkAcceptConnection(PancakeSocket *
 	fcntl(fd, F_SETFL, flags);
 #endif
 
-	client = PancakeAllocate(sizeof(PancakeSocket));
+	client = PancakePoolAllocate(&socketPool);
 	client->fd = fd;
 	client->localAddress = sock->localAddress;
 	client->remoteAddress = addr;
@@ -591,56 +1344,217 @@ PANCAKE_API inline PancakeSocket *PancakeNetworkAcceptConnection(PancakeSocket *
 	client->writeBuffer.size = 0;
 	client->writeBuffer.length = 0;
 	client->writeBuffer.value = NULL;
+	client->writeBuffer.offset = 0;
+	client->timeoutEvent = NULL;
+	client->deadline = 0;
 	client->layer = sock->layer;
 
 	if(client->layer && EXPECTED(client->layer->acceptConnection != NULL)) {
 		if(!client->layer->acceptConnection(&client, sock)) {
 			close(fd);
-			PancakeFree(client);
+			PancakePoolFree(&socketPool, client);
 			return NULL;
 		}
 	}
 
+	client->flags |= PANCAKE_NETWORK_CLIENT | PANCAKE_NETWORK_STREAM;
+	numClientConnections++;
+
+	PancakeStatisticsIncrement(acceptedConnections);
+	PancakeStatisticsIncrement(activeConnections);
+
+	// Stop polling listen sockets until connections were closed
+	if(PancakeMainConfiguration.concurrencyLimit && numClientConnections >= PancakeMainConfiguration.concurrencyLimit) {
+		PancakeNetworkSetListenSocketsPaused(1);
+	}
+
 	return client;
 }
 
-PANCAKE_API extern inline void PancakeNetworkCacheConnection(PancakeNetworkConnectionCache **cache, PancakeSocket *socket) {
-	PancakeNetworkConnectionCache *connection = PancakeAllocate(sizeof(PancakeNetworkConnectionCache));
+STATIC void PancakeNetworkDetachCachedConnection(PancakeNetworkConnectionCacheEntry *entry) {
+	PancakeNetworkConnectionCache *cache = entry->cache;
+
+	if(entry->idle) {
+		DL_DELETE(cache->idle, entry);
+		cache->numIdle--;
+	}
+
+	if(entry->idleTimeout) {
+		PancakeUnschedule(entry->idleTimeout);
+	}
+
+	HASH_DEL(cachedConnections, entry);
+	cache->numTotal--;
+
+	entry->socket->flags &= ~(PANCAKE_NETWORK_CACHED);
+	PancakePoolFree(&connectionCachePool, entry);
+}
+
+STATIC void PancakeNetworkOnCachedConnectionIdleTimeout(PancakeNetworkConnectionCacheEntry *entry) {
+	// Event is removed by the scheduler
+	entry->idleTimeout = NULL;
+
+	// Let the owner close the connection, this removes it from the cache
+	entry->socket->onRemoteHangup(entry->socket);
+}
+
+STATIC PancakeNetworkConnectionCacheEntry *PancakeNetworkAddCachedConnection(PancakeNetworkConnectionCache *cache, PancakeSocket *sock) {
+	PancakeNetworkConnectionCacheEntry *entry = PancakePoolAllocate(&connectionCachePool);
+
+	entry->socket = sock;
+	entry->cache = cache;
+	entry->idleTimeout = NULL;
+	entry->idle = 0;
+	entry->requests = 0;
+
+	HASH_ADD_PTR(cachedConnections, socket, entry);
+	cache->numTotal++;
+
+	sock->flags |= PANCAKE_NETWORK_CACHED;
+
+	return entry;
+}
+
+STATIC UByte PancakeNetworkIsCachedConnectionAlive(PancakeSocket *sock) {
+	UByte buf;
+
+	// Idle connections must not have pending data, EOF means the remote host closed the connection
+	if(recv(sock->fd, &buf, 1, MSG_PEEK | MSG_DONTWAIT) == -1) {
+#if EAGAIN != EWOULDBLOCK // On some systems these values differ
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+#else
+		return errno == EAGAIN;
+#endif
+	}
+
+	return 0;
+}
+
+PANCAKE_API void PancakeNetworkInitializeConnectionCache(PancakeNetworkConnectionCache *cache) {
+	cache->idle = NULL;
+	cache->numIdle = 0;
+	cache->numTotal = 0;
+	cache->maxIdle = 0;
+	cache->maxTotal = 0;
+	cache->idleTimeout = 0;
+	cache->hits = 0;
+	cache->misses = 0;
+}
+
+PANCAKE_API void PancakeNetworkCacheConnection(PancakeNetworkConnectionCache *cache, PancakeSocket *sock) {
+	PancakeNetworkConnectionCacheEntry *entry = NULL;
+
+	if(sock->flags & PANCAKE_NETWORK_CACHED) {
+		HASH_FIND_PTR(cachedConnections, &sock, entry);
+	}
+
+	if(entry == NULL) {
+		entry = PancakeNetworkAddCachedConnection(cache, sock);
+	} else if(entry->idle) {
+		// Request sharing a kept connection is done with it
+		if(entry->requests && !--entry->requests && cache->idleTimeout) {
+			entry->idleTimeout = PancakeScheduleIn(cache->idleTimeout * 1000, (PancakeSchedulerEventCallback) PancakeNetworkOnCachedConnectionIdleTimeout, entry);
+		}
+
+		return;
+	}
+
+	// Close the least recently used connection instead of the one just released since its owner might still be using it
+	if(cache->maxIdle && cache->numIdle >= cache->maxIdle) {
+		PancakeNetworkConnectionCacheEntry *leastRecentlyUsed = cache->idle->prev;
+
+		// Kept connections still serving requests are skipped
+		while(leastRecentlyUsed->requests) {
+			if(leastRecentlyUsed == cache->idle) {
+				leastRecentlyUsed = NULL;
+				break;
+			}
+
+			leastRecentlyUsed = leastRecentlyUsed->prev;
+		}
+
+		if(leastRecentlyUsed) {
+			leastRecentlyUsed->socket->onRemoteHangup(leastRecentlyUsed->socket);
+		}
+	}
+
+	// Warm connections are reused first
+	DL_PREPEND(cache->idle, entry);
+	cache->numIdle++;
+	entry->idle = 1;
 
-	connection->socket = socket;
-	// Prepend to prevent iteration through long cache lists
-	LL_PREPEND((*cache), connection);
+	if(cache->idleTimeout && !entry->requests) {
+		entry->idleTimeout = PancakeScheduleIn(cache->idleTimeout * 1000, (PancakeSchedulerEventCallback) PancakeNetworkOnCachedConnectionIdleTimeout, entry);
+	}
 }
 
-PANCAKE_API extern inline void PancakeNetworkUncacheConnection(PancakeNetworkConnectionCache **cache, PancakeSocket *sock) {
-	PancakeNetworkConnectionCache *connection = NULL;
+PANCAKE_API void PancakeNetworkUncacheConnection(PancakeNetworkConnectionCache *cache, PancakeSocket *sock) {
+	PancakeNetworkConnectionCacheEntry *entry;
+
+	if(!(sock->flags & PANCAKE_NETWORK_CACHED)) {
+		return;
+	}
 
-	LL_SEARCH_SCALAR(*cache, connection, socket, sock);
+	HASH_FIND_PTR(cachedConnections, &sock, entry);
 
-	if(connection) {
-		LL_DELETE(*cache, connection);
-		PancakeFree(connection);
+	if(entry) {
+		PancakeAssert(entry->cache == cache);
+		PancakeNetworkDetachCachedConnection(entry);
 	}
 }
 
-PANCAKE_API extern inline PancakeSocket *PancakeNetworkConnect(struct sockaddr *addr, PancakeNetworkConnectionCache **cache, UByte cachePolicy) {
+PANCAKE_API extern inline PancakeSocket *PancakeNetworkConnect(PancakeNetworkClientInterface *client, PancakeNetworkConnectionCache *cache, UByte cachePolicy) {
+	struct sockaddr *addr = client->address;
 	Int32 fd, flags, structSize;
+	UByte connecting = 0;
 	PancakeSocket *remote;
 
-	if(cache && *cache) {
+	if(cache) {
 		PancakeAssert(cachePolicy == PANCAKE_NETWORK_CONNECTION_CACHE_KEEP || cachePolicy == PANCAKE_NETWORK_CONNECTION_CACHE_REMOVE);
 
-		if(cachePolicy == PANCAKE_NETWORK_CONNECTION_CACHE_KEEP) {
-			return (*cache)->socket;
-		} else {
-			PancakeNetworkConnectionCache *current = *cache;
-			remote = (*cache)->socket;
+		while(cache->idle) {
+			PancakeNetworkConnectionCacheEntry *entry = cache->idle;
+
+			remote = entry->socket;
+
+			// Connections in use are shared when keeping them in the cache
+			if(cachePolicy == PANCAKE_NETWORK_CONNECTION_CACHE_KEEP) {
+				entry->requests++;
+
+				if(entry->idleTimeout) {
+					PancakeUnschedule(entry->idleTimeout);
+					entry->idleTimeout = NULL;
+				}
+
+				cache->hits++;
+				return remote;
+			}
+
+			// Drop connections closed by the remote host while idling
+			if(UNEXPECTED(!PancakeNetworkIsCachedConnectionAlive(remote))) {
+				remote->onRemoteHangup(remote);
+				continue;
+			}
+
+			DL_DELETE(cache->idle, entry);
+			cache->numIdle--;
+			entry->idle = 0;
 
-			LL_DELETE((*cache), (*cache));
-			PancakeFree(current);
+			if(entry->idleTimeout) {
+				PancakeUnschedule(entry->idleTimeout);
+				entry->idleTimeout = NULL;
+			}
 
+			cache->hits++;
 			return remote;
 		}
+
+		cache->misses++;
+
+		if(cache->maxTotal && cache->numTotal >= cache->maxTotal) {
+			errno = EAGAIN;
+			return NULL;
+		}
 	}
 
 	// Create socket
@@ -668,38 +1582,384 @@ PANCAKE_API extern inline PancakeSocket *PancakeNetworkConnect(struct sockaddr *
 	flags |= O_NONBLOCK;
 	fcntl(fd, F_SETFL, flags);
 
-	// Try to connect
-	if(connect(fd, addr, structSize) == -1) {
+	if(!PancakeNetworkApplySocketOptions(fd, addr->sa_family, &client->socketOptions, PANCAKE_NETWORK_SOCKET_OPTIONS_CLIENT)) {
 		close(fd);
 		return NULL;
 	}
 
+	// Try to connect, TCP connections are usually established asynchronously
+	if(connect(fd, addr, structSize) == -1) {
+		if(errno != EINPROGRESS) {
+			close(fd);
+			return NULL;
+		}
+
+		connecting = 1;
+	}
+
 	// Allocate and initialize PancakeSocket
-	remote = PancakeAllocate(sizeof(PancakeSocket));
+	remote = PancakePoolAllocate(&socketPool);
 	remote->fd = fd;
-	remote->flags = 0;
+	remote->flags = connecting ? PANCAKE_NETWORK_CONNECTING | PANCAKE_NETWORK_STREAM : PANCAKE_NETWORK_STREAM;
 	remote->readBuffer.size = 0;
 	remote->readBuffer.length = 0;
 	remote->readBuffer.value = NULL;
 	remote->writeBuffer.size = 0;
 	remote->writeBuffer.length = 0;
 	remote->writeBuffer.value = NULL;
+	remote->writeBuffer.offset = 0;
+	remote->timeoutEvent = NULL;
+	remote->deadline = 0;
 	remote->layer = NULL;
 
-	if(cache && cachePolicy == PANCAKE_NETWORK_CONNECTION_CACHE_KEEP) {
-		PancakeNetworkCacheConnection(cache, remote);
+	if(cache) {
+		if(cachePolicy == PANCAKE_NETWORK_CONNECTION_CACHE_KEEP) {
+			// Connection is shared right away, its idle timer starts once the request released it
+			PancakeNetworkAddCachedConnection(cache, remote)->requests = 1;
+			PancakeNetworkCacheConnection(cache, remote);
+		} else {
+			// Count connection towards the limit of the cache while it is in use
+			PancakeNetworkAddCachedConnection(cache, remote);
+		}
 	}
 
 	return remote;
 }
 
+STATIC void PancakeNetworkFinishConnect(PancakeNetworkConnectState *state, Int32 error) {
+	PancakeSocket *sock = state->socket;
+	PancakeNetworkConnectCallback callback = state->callback;
+
+	HASH_DEL(connectStates, state);
+
+	if(state->timeout) {
+		PancakeUnschedule(state->timeout);
+	}
+
+	// Restore handlers of the socket
+	sock->onRead = state->onRead;
+	sock->onWrite = state->onWrite;
+	sock->onRemoteHangup = state->onRemoteHangup;
+	sock->flags &= ~(PANCAKE_NETWORK_CONNECTING);
+
+	PancakeFree(state);
+
+	// Write readiness was only requested for the connect
+	PancakeNetworkRemoveWriteSocket(sock);
+
+	// Callback must close the socket on error
+	callback(sock, error);
+}
+
+STATIC Int32 PancakeNetworkGetConnectError(PancakeSocket *sock) {
+	struct sockaddr_storage address;
+	Int32 error = 0;
+	socklen_t length = sizeof(Int32);
+
+	if(getsockopt(sock->fd, SOL_SOCKET, SO_ERROR, &error, &length) == -1) {
+		return errno;
+	}
+
+	if(error) {
+		return error;
+	}
+
+	// No error is pending while connecting either, check whether there is a peer
+	length = sizeof(address);
+
+	if(getpeername(sock->fd, (struct sockaddr*) &address, &length) == -1) {
+		return errno == ENOTCONN ? EINPROGRESS : errno;
+	}
+
+	return 0;
+}
+
+STATIC void PancakeNetworkOnConnectEvent(PancakeSocket *sock) {
+	PancakeNetworkConnectState *state;
+	Int32 error;
+
+	HASH_FIND_PTR(connectStates, &sock, state);
+	PancakeAssert(state != NULL);
+
+	error = PancakeNetworkGetConnectError(sock);
+
+	// Spurious wakeup, connection is still in progress
+	if(error == EINPROGRESS) {
+		return;
+	}
+
+	PancakeNetworkFinishConnect(state, error);
+}
+
+STATIC void PancakeNetworkOnConnectHangup(PancakeSocket *sock) {
+	PancakeNetworkConnectState *state;
+	Int32 error;
+
+	HASH_FIND_PTR(connectStates, &sock, state);
+	PancakeAssert(state != NULL);
+
+	error = PancakeNetworkGetConnectError(sock);
+
+	PancakeNetworkFinishConnect(state, error && error != EINPROGRESS ? error : ECONNRESET);
+}
+
+STATIC void PancakeNetworkOnConnectTimeout(PancakeNetworkConnectState *state) {
+	// Event is removed by the scheduler
+	state->timeout = NULL;
+
+	PancakeNetworkFinishConnect(state, ETIMEDOUT);
+}
+
+PANCAKE_API void PancakeNetworkOnConnect(PancakeSocket *sock, UInt32 timeout, PancakeNetworkConnectCallback callback) {
+	PancakeNetworkConnectState *state;
+
+	// Connection is already established
+	if(!(sock->flags & PANCAKE_NETWORK_CONNECTING)) {
+		callback(sock, 0);
+		return;
+	}
+
+	HASH_FIND_PTR(connectStates, &sock, state);
+
+	// Socket is already waiting, the first timeout stays in effect
+	if(state) {
+		state->callback = callback;
+		return;
+	}
+
+	state = PancakeAllocate(sizeof(PancakeNetworkConnectState));
+	state->socket = sock;
+	state->callback = callback;
+	state->onRead = sock->onRead;
+	state->onWrite = sock->onWrite;
+	state->onRemoteHangup = sock->onRemoteHangup;
+	state->timeout = timeout ? PancakeScheduleIn(timeout, (PancakeSchedulerEventCallback) PancakeNetworkOnConnectTimeout, state) : NULL;
+
+	HASH_ADD_PTR(connectStates, socket, state);
+
+	// Socket becomes writable once the connection is established or failed
+	sock->onRead = PancakeNetworkOnConnectEvent;
+	sock->onWrite = PancakeNetworkOnConnectEvent;
+	sock->onRemoteHangup = PancakeNetworkOnConnectHangup;
+
+	PancakeNetworkAddWriteSocket(sock);
+}
+
+PANCAKE_API void PancakeNetworkSetHandlers(PancakeSocket *sock, PancakeNetworkEventHandler onRead, PancakeNetworkEventHandler onWrite, PancakeNetworkEventHandler onRemoteHangup) {
+	if(UNEXPECTED(sock->flags & PANCAKE_NETWORK_CONNECTING)) {
+		PancakeNetworkConnectState *state;
+
+		HASH_FIND_PTR(connectStates, &sock, state);
+
+		// Connect handlers stay installed, the handlers are restored once the connection is established
+		if(state) {
+			state->onRead = onRead;
+			state->onWrite = onWrite;
+			state->onRemoteHangup = onRemoteHangup;
+			return;
+		}
+	}
+
+	sock->onRead = onRead;
+	sock->onWrite = onWrite;
+	sock->onRemoteHangup = onRemoteHangup;
+}
+
+STATIC void PancakeNetworkOnTimeoutEvent(PancakeSocket *sock) {
+	UInt64 now;
+
+	// Event is removed by the scheduler
+	sock->timeoutEvent = NULL;
+
+	// Timeout was cleared meanwhile
+	if(!sock->deadline) {
+		return;
+	}
+
+	now = PancakeNowMilliseconds();
+
+	// Deadline was moved meanwhile, wait for the remaining time unless all events are run on shutdown
+	if(sock->deadline > now && !PancakeSchedulerIsShuttingDown()) {
+		sock->timeoutEvent = PancakeScheduleIn(sock->deadline - now, (PancakeSchedulerEventCallback) PancakeNetworkOnTimeoutEvent, sock);
+		return;
+	}
+
+	sock->deadline = 0;
+	sock->onTimeout(sock);
+}
+
+PANCAKE_API void PancakeNetworkSetTimeout(PancakeSocket *sock, UInt32 milliseconds, PancakeNetworkEventHandler onTimeout) {
+	sock->deadline = PancakeNowMilliseconds() + milliseconds;
+	sock->onTimeout = onTimeout;
+
+	if(sock->timeoutEvent) {
+		// Pending event fires before the deadline and re-arms itself
+		if(EXPECTED(sock->timeoutEvent->time <= sock->deadline)) {
+			return;
+		}
+
+		PancakeUnschedule(sock->timeoutEvent);
+	}
+
+	sock->timeoutEvent = PancakeScheduleIn(milliseconds, (PancakeSchedulerEventCallback) PancakeNetworkOnTimeoutEvent, sock);
+}
+
+PANCAKE_API extern inline void PancakeNetworkClearTimeout(PancakeSocket *sock) {
+	// Pending event is dropped when it fires
+	sock->deadline = 0;
+}
+
+STATIC UByte *PancakeNetworkCarveBuffer(UInt32 size) {
+	UByte *buffer;
+
+	if(bufferChunkEnd - bufferChunkOffset < size) {
+		PancakeNetworkBufferChunk *chunk = PancakeAllocate(sizeof(PancakeNetworkBufferChunk));
+
+		// Remaining space of the previous chunk is lost, it is smaller than the largest size class
+		chunk->mapped = 0;
+
+#ifdef HAVE_SYS_MMAN_H
+		chunk->memory = MAP_FAILED;
+
+#	ifdef MAP_HUGETLB
+		chunk->memory = mmap(NULL, PANCAKE_NETWORK_BUFFER_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#	endif
+
+		if(chunk->memory == MAP_FAILED) {
+			// No huge pages reserved, ask for transparent huge pages instead
+			chunk->memory = mmap(NULL, PANCAKE_NETWORK_BUFFER_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+#	ifdef MADV_HUGEPAGE
+			if(chunk->memory != MAP_FAILED) {
+				madvise(chunk->memory, PANCAKE_NETWORK_BUFFER_CHUNK_SIZE, MADV_HUGEPAGE);
+			}
+#	endif
+		}
+
+		if(EXPECTED(chunk->memory != MAP_FAILED)) {
+			chunk->mapped = 1;
+		} else
+#endif
+		{
+			chunk->memory = PancakeAllocate(PANCAKE_NETWORK_BUFFER_CHUNK_SIZE);
+		}
+
+		LL_PREPEND(bufferChunks, chunk);
+
+		bufferChunkOffset = chunk->memory;
+		bufferChunkEnd = chunk->memory + PANCAKE_NETWORK_BUFFER_CHUNK_SIZE;
+	}
+
+	buffer = bufferChunkOffset;
+	bufferChunkOffset += size;
+
+	return buffer;
+}
+
+PANCAKE_API void PancakeNetworkBufferReserve(PancakeNetworkBuffer *buffer, UInt32 size) {
+	UInt32 classSize = PANCAKE_NETWORK_BUFFER_MIN;
+	UByte index = 0;
+	UByte *value;
+
+	if(EXPECTED(buffer->size >= size)) {
+		return;
+	}
+
+	while(classSize < size) {
+		classSize *= 2;
+		index++;
+	}
+
+	PancakeDebug {
+		numBufferAllocations++;
+	}
+
+	// Buffers larger than NetworkBuffering.Max are not pooled
+	if(UNEXPECTED(classSize > maxBufferClassSize)) {
+		if(buffer->size > maxBufferClassSize) {
+			buffer->value = PancakeReallocate(buffer->value, classSize);
+			buffer->size = classSize;
+			return;
+		}
+
+		value = PancakeAllocate(classSize);
+	} else if(bufferClasses[index].freeBuffers) {
+		PancakeDebug {
+			numBufferReuses++;
+		}
+
+		value = bufferClasses[index].freeBuffers;
+		bufferClasses[index].freeBuffers = *((UByte**) value);
+		bufferClasses[index].numFree--;
+	} else if(PancakeMainConfiguration.networkBufferingHugePages && classSize <= PANCAKE_NETWORK_BUFFER_CHUNK_SIZE) {
+		value = PancakeNetworkCarveBuffer(classSize);
+	} else {
+		value = PancakeAllocate(classSize);
+	}
+
+	if(buffer->size) {
+		UInt32 length = buffer->length, offset = buffer->offset;
+
+		memcpy(value, buffer->value, length);
+		PancakeNetworkBufferRelease(buffer);
+
+		buffer->length = length;
+		buffer->offset = offset;
+	}
+
+	buffer->value = value;
+	buffer->size = classSize;
+}
+
+PANCAKE_API void PancakeNetworkBufferRelease(PancakeNetworkBuffer *buffer) {
+	if(buffer->size) {
+		if(buffer->size > maxBufferClassSize) {
+			PancakeFree(buffer->value);
+		} else {
+			UInt32 classSize = PANCAKE_NETWORK_BUFFER_MIN;
+			UByte index = 0;
+
+			while(classSize < buffer->size) {
+				classSize *= 2;
+				index++;
+			}
+
+			PancakeAssert(classSize == buffer->size);
+
+			// Buffers carved from huge page chunks can't be freed on their own
+			if(bufferClasses[index].numFree >= PANCAKE_NETWORK_BUFFER_POOL_MAX_FREE
+			&& !(PancakeMainConfiguration.networkBufferingHugePages && classSize <= PANCAKE_NETWORK_BUFFER_CHUNK_SIZE)) {
+				PancakeFree(buffer->value);
+			} else {
+				*((UByte**) buffer->value) = bufferClasses[index].freeBuffers;
+				bufferClasses[index].freeBuffers = buffer->value;
+				bufferClasses[index].numFree++;
+			}
+		}
+	}
+
+	buffer->value = NULL;
+	buffer->size = 0;
+	buffer->length = 0;
+	buffer->offset = 0;
+}
+
 PANCAKE_API extern inline Int32 PancakeNetworkRead(PancakeSocket *sock, UInt32 maxLength) {
-	UByte buf[maxLength];
 	Int32 length;
 
+	// Make room for maxLength bytes, data is read directly into the buffer
+	if(sock->readBuffer.size - sock->readBuffer.length < maxLength) {
+		PancakeDebug {
+			numReadBufferGrowths++;
+			numReadBufferBytesMoved += sock->readBuffer.length;
+		}
+
+		PancakeNetworkBufferReserve(&sock->readBuffer, sock->readBuffer.length + maxLength);
+	}
+
 	if(sock->layer && EXPECTED(sock->layer->read != NULL)) {
 		// Read through network layer
-		length = sock->layer->read(sock, maxLength, buf);
+		length = sock->layer->read(sock, maxLength);
 
 		if(length == -1) {
 			PancakeAssert(sock->onRemoteHangup != NULL);
@@ -707,8 +1967,10 @@ PANCAKE_API extern inline Int32 PancakeNetworkRead(PancakeSocket *sock, UInt32 m
 			return -1;
 		}
 	} else {
-		// Directly read from socket
-		length = read(sock->fd, buf, maxLength);
+		// Directly read from socket unless the server architecture receives data itself
+		length = PancakeMainConfiguration.serverArchitecture->read
+				? PancakeMainConfiguration.serverArchitecture->read(sock, sock->readBuffer.value + sock->readBuffer.length, maxLength)
+				: read(sock->fd, sock->readBuffer.value + sock->readBuffer.length, maxLength);
 
 		if(length == -1) {
 #if EAGAIN != EWOULDBLOCK // On some systems these values differ
@@ -717,6 +1979,7 @@ PANCAKE_API extern inline Int32 PancakeNetworkRead(PancakeSocket *sock, UInt32 m
 			if(errno == EAGAIN)
 #endif
 			{
+				sock->flags &= ~(PANCAKE_NETWORK_READABLE);
 				return 0;
 			}
 
@@ -724,14 +1987,21 @@ PANCAKE_API extern inline Int32 PancakeNetworkRead(PancakeSocket *sock, UInt32 m
 			sock->onRemoteHangup(sock);
 			return -1;
 		}
+
+		// Socket buffer is drained after a short read
+		if(length < maxLength) {
+			sock->flags &= ~(PANCAKE_NETWORK_READABLE);
+		}
 	}
 
-	if(sock->readBuffer.size < sock->readBuffer.length + length) {
-		sock->readBuffer.size += length + 64;
-		sock->readBuffer.value = PancakeReallocate(sock->readBuffer.value, sock->readBuffer.size);
+	PancakeDebug {
+		numBytesRead += length;
 	}
 
-	memcpy(sock->readBuffer.value + sock->readBuffer.length, buf, length);
+	// Only count client traffic, upstream traffic would be counted twice
+	if(sock->flags & PANCAKE_NETWORK_CLIENT) {
+		PancakeStatisticsAdd(bytesIn, length);
+	}
 
 	sock->readBuffer.length += length;
 
@@ -741,6 +2011,11 @@ PANCAKE_API extern inline Int32 PancakeNetworkRead(PancakeSocket *sock, UInt32 m
 PANCAKE_API extern inline Int32 PancakeNetworkWrite(PancakeSocket *sock) {
 	Int32 length;
 
+	// Data is sent once the connection is established
+	if(UNEXPECTED(sock->flags & PANCAKE_NETWORK_CONNECTING)) {
+		return 0;
+	}
+
 	if(sock->layer && EXPECTED(sock->layer->write != NULL)) {
 		// Write through network layer
 		length = sock->layer->write(sock);
@@ -751,8 +2026,10 @@ PANCAKE_API extern inline Int32 PancakeNetworkWrite(PancakeSocket *sock) {
 			return -1;
 		}
 	} else {
-		// Write data directly to socket
-		length = write(sock->fd, sock->writeBuffer.value, sock->writeBuffer.length);
+		// Write data directly to socket unless the server architecture sends data itself
+		length = PancakeMainConfiguration.serverArchitecture->write
+				? PancakeMainConfiguration.serverArchitecture->write(sock, sock->writeBuffer.value + sock->writeBuffer.offset, sock->writeBuffer.length - sock->writeBuffer.offset)
+				: write(sock->fd, sock->writeBuffer.value + sock->writeBuffer.offset, sock->writeBuffer.length - sock->writeBuffer.offset);
 
 		if(length == -1) {
 #if EAGAIN != EWOULDBLOCK // On some systems these values differ
@@ -761,6 +2038,7 @@ PANCAKE_API extern inline Int32 PancakeNetworkWrite(PancakeSocket *sock) {
 			if(errno == EAGAIN)
 #endif
 			{
+				sock->flags &= ~(PANCAKE_NETWORK_WRITABLE);
 				return 0;
 			}
 
@@ -768,14 +2046,28 @@ PANCAKE_API extern inline Int32 PancakeNetworkWrite(PancakeSocket *sock) {
 			sock->onRemoteHangup(sock);
 			return -1;
 		}
+
+		// Socket buffer is full after a short write
+		if(length < sock->writeBuffer.length - sock->writeBuffer.offset) {
+			sock->flags &= ~(PANCAKE_NETWORK_WRITABLE);
+		}
 	}
 
-	// Shrink buffer
-	if(length < sock->writeBuffer.length) {
-		memmove(sock->writeBuffer.value, sock->writeBuffer.value + length, sock->writeBuffer.length - length);
-		sock->writeBuffer.length -= length;
-	} else {
+	if(sock->flags & PANCAKE_NETWORK_CLIENT) {
+		PancakeStatisticsAdd(bytesOut, length);
+	}
+
+	sock->writeBuffer.offset += length;
+
+	if(sock->writeBuffer.offset >= sock->writeBuffer.length) {
+		// Buffer is empty
 		sock->writeBuffer.length = 0;
+		sock->writeBuffer.offset = 0;
+	} else if(sock->writeBuffer.offset >= sock->writeBuffer.length - sock->writeBuffer.offset) {
+		// Only move remaining data once it isn't larger than the data already written, keeps moving amortized linear
+		sock->writeBuffer.length -= sock->writeBuffer.offset;
+		memmove(sock->writeBuffer.value, sock->writeBuffer.value + sock->writeBuffer.offset, sock->writeBuffer.length);
+		sock->writeBuffer.offset = 0;
 	}
 
 	return length;
@@ -785,6 +2077,38 @@ PANCAKE_API extern inline void PancakeNetworkClose(PancakeSocket *sock) {
 	// Tell server architecture we're closing the socket
 	PancakeMainConfiguration.serverArchitecture->onSocketClose(sock);
 
+	if(sock->timeoutEvent) {
+		PancakeUnschedule(sock->timeoutEvent);
+	}
+
+	// Drop pending connect
+	if(UNEXPECTED(sock->flags & PANCAKE_NETWORK_CONNECTING)) {
+		PancakeNetworkConnectState *state;
+
+		HASH_FIND_PTR(connectStates, &sock, state);
+
+		if(state) {
+			HASH_DEL(connectStates, state);
+
+			if(state->timeout) {
+				PancakeUnschedule(state->timeout);
+			}
+
+			PancakeFree(state);
+		}
+	}
+
+	// Remove socket from its connection cache
+	if(sock->flags & PANCAKE_NETWORK_CACHED) {
+		PancakeNetworkConnectionCacheEntry *entry;
+
+		HASH_FIND_PTR(cachedConnections, &sock, entry);
+
+		if(entry) {
+			PancakeNetworkDetachCachedConnection(entry);
+		}
+	}
+
 	if(sock->layer && EXPECTED(sock->layer->close != NULL)) {
 		sock->layer->close(sock);
 	}
@@ -792,18 +2116,26 @@ PANCAKE_API extern inline void PancakeNetworkClose(PancakeSocket *sock) {
 	// Close underlying file descriptor
 	close(sock->fd);
 
-	// Free read buffer
-	if(sock->readBuffer.size) {
-		PancakeFree(sock->readBuffer.value);
-	}
+	// Return buffers to pool
+	PancakeNetworkBufferRelease(&sock->readBuffer);
+	PancakeNetworkBufferRelease(&sock->writeBuffer);
 
-	// Free write buffer
-	if(sock->writeBuffer.size) {
-		PancakeFree(sock->writeBuffer.value);
+	if(sock->flags & PANCAKE_NETWORK_CLIENT) {
+		numClientConnections--;
+		PancakeStatisticsDecrement(activeConnections);
+
+		if(sock->flags & PANCAKE_NETWORK_IDLE) {
+			numIdleClientConnections--;
+		}
+
+		// Resume accepting at the low-water mark
+		if(UNEXPECTED(listenSocketsPaused) && !draining && numClientConnections <= PancakeMainConfiguration.concurrencyLimit - PancakeMainConfiguration.concurrencyLimit / 10 - 1) {
+			PancakeNetworkSetListenSocketsPaused(0);
+		}
 	}
 
 	// Free socket
-	PancakeFree(sock);
+	PancakePoolFree(&socketPool, sock);
 }
 
 #ifdef PANCAKE_NETWORK_TLS
@@ -10,15 +10,22 @@ typedef struct _PancakeServerArchitecture PancakeServerArchitecture;
 /* Forward declarations */
 typedef struct _PancakeSocket PancakeSocket;
 typedef struct _PancakeNetworkConnectionCache PancakeNetworkConnectionCache;
+typedef struct _PancakeNetworkConnectionCacheEntry PancakeNetworkConnectionCacheEntry;
 typedef struct _PancakeNetworkLayer PancakeNetworkLayer;
 
 typedef void (*PancakeNetworkEventHandler)(PancakeSocket *socket);
 typedef void (*PancakeSocketHandler)(PancakeSocket *socket);
+typedef Int32 (*PancakeServerArchitectureAcceptFunction)(PancakeSocket *socket, struct sockaddr *address);
+typedef Int32 (*PancakeServerArchitectureTransferFunction)(PancakeSocket *socket, UByte *buffer, UInt32 length);
+typedef void (*PancakeNetworkConnectCallback)(PancakeSocket *socket, Int32 error);
 
 typedef struct _PancakeNetworkBuffer {
 	UByte *value;
 	UInt32 length;
 	UInt32 size;
+
+	// Data before offset has already been written (write buffers only)
+	UInt32 offset;
 } PancakeNetworkBuffer;
 
 typedef struct _PancakeSocket {
@@ -34,6 +41,11 @@ typedef struct _PancakeSocket {
 	struct sockaddr *localAddress;
 	struct sockaddr remoteAddress;
 
+	// Timeout is re-armed lazily when its event fires before the deadline
+	struct _PancakeSchedulerEvent *timeoutEvent;
+	UInt64 deadline; /* milliseconds of monotonic clock, 0 if no timeout is set */
+	PancakeNetworkEventHandler onTimeout;
+
 	void *data;
 } PancakeSocket;
 
@@ -56,26 +68,63 @@ typedef struct _PancakeServerArchitecture {
 
 	PancakeSocketHandler onSocketClose;
 
+	// Optional, for architectures accepting connections asynchronously
+	PancakeServerArchitectureAcceptFunction acceptConnection;
+
+	// Optional, for architectures transferring data of stream sockets asynchronously
+	// Same semantics as read() and write(), write is always passed the unsent rest of the write buffer
+	PancakeServerArchitectureTransferFunction read;
+	PancakeServerArchitectureTransferFunction write;
+
 	PancakeModuleInitializeFunction initialize;
 
 	UT_hash_handle hh;
 } PancakeServerArchitecture;
 
+/* Socket options of interfaces, 0 leaves the system default */
+typedef struct _PancakeNetworkSocketOptions {
+	Int32 noDelay;
+	Int32 deferAccept; /* seconds, listen sockets only */
+	Int32 fastOpen; /* queue length on listen sockets, boolean on client sockets */
+	Int32 sendBuffer;
+	Int32 receiveBuffer;
+	Int32 notSentLowWatermark;
+	Int32 keepAlive; /* idle seconds before sending keep-alive probes */
+} PancakeNetworkSocketOptions;
+
 typedef struct _PancakeNetworkClientInterface {
 	struct sockaddr *address;
+	PancakeNetworkSocketOptions socketOptions;
 } PancakeNetworkClientInterface;
 
+/* Pool of connections to a single upstream, idle connections are reused most recently used first.
+ * Expired or broken connections are closed through their onRemoteHangup handler. */
 typedef struct _PancakeNetworkConnectionCache {
-	PancakeSocket *socket;
+	PancakeNetworkConnectionCacheEntry *idle;
+
+	UInt32 numIdle;
+	UInt32 numTotal;
 
-	PancakeNetworkConnectionCache *next;
+	/* Limits, 0 means unlimited */
+	UInt32 maxIdle;
+	UInt32 maxTotal;
+
+	/* Seconds after which idle connections are closed, 0 keeps them forever */
+	UInt32 idleTimeout;
+
+	UNative hits;
+	UNative misses;
 } PancakeNetworkConnectionCache;
 
 #define PANCAKE_NETWORK_LAYER_MODE_SERVER 1
 #define PANCAKE_NETWORK_LAYER_MODE_CLIENT 2
 
+#define PANCAKE_NETWORK_SOCKET_OPTIONS_LISTEN 1
+#define PANCAKE_NETWORK_SOCKET_OPTIONS_CLIENT 2
+
 typedef UByte (*PancakeNetworkLayerAcceptConnectionFunction)(PancakeSocket **socket, PancakeSocket *parent);
-typedef Int32 (*PancakeNetworkLayerReadFunction)(PancakeSocket *socket, UInt32 maxLength, UByte *buf);
+/* Reads at most maxLength bytes to readBuffer.value + readBuffer.length, space is reserved by the caller */
+typedef Int32 (*PancakeNetworkLayerReadFunction)(PancakeSocket *socket, UInt32 maxLength);
 typedef Int32 (*PancakeNetworkLayerWriteFunction)(PancakeSocket *socket);
 typedef void (*PancakeNetworkLayerCloseFunction)(PancakeSocket *socket);
 typedef void (*PancakeNetworkLayerConfigurationFunction)(PancakeConfigurationGroup *parent, UByte mode);
@@ -89,6 +138,9 @@ typedef struct _PancakeNetworkLayer {
 	PancakeNetworkLayerWriteFunction write;
 	PancakeNetworkLayerCloseFunction close;
 
+	/* Size of sockets using this layer, allocated in advance for every connection */
+	UInt32 socketSize;
+
 	struct _PancakeNetworkLayer *next;
 } PancakeNetworkLayer;
 
@@ -106,19 +158,32 @@ PANCAKE_API UByte PancakeNetworkInterfaceConfiguration(UByte step, config_settin
 PANCAKE_API void PancakeNetworkClientInterfaceConfiguration(PancakeNetworkClientInterface *client);
 PANCAKE_API Byte *PancakeNetworkGetInterfaceName(struct sockaddr *addr);
 PANCAKE_API void PancakeNetworkReplaceListenSocket(PancakeSocket *previous, PancakeSocket *new);
+PANCAKE_API UByte PancakeNetworkApplySocketOptions(Int32 fd, sa_family_t family, PancakeNetworkSocketOptions *options, UByte mode);
 
 PANCAKE_API PancakeSocket *PancakeNetworkAcceptConnection(PancakeSocket *sock);
-PANCAKE_API PancakeSocket *PancakeNetworkConnect(struct sockaddr *addr, PancakeNetworkConnectionCache **cache, UByte cachePolicy);
+PANCAKE_API PancakeSocket *PancakeNetworkConnect(PancakeNetworkClientInterface *client, PancakeNetworkConnectionCache *cache, UByte cachePolicy);
 PANCAKE_API Int32 PancakeNetworkRead(PancakeSocket *sock, UInt32 maxLength);
 PANCAKE_API Int32 PancakeNetworkWrite(PancakeSocket *sock);
 PANCAKE_API void PancakeNetworkClose(PancakeSocket *sock);
 
 PANCAKE_API void PancakeNetworkActivateListenSockets();
-PANCAKE_API void PancakeNetworkCacheConnection(PancakeNetworkConnectionCache **cache, PancakeSocket *socket);
-PANCAKE_API void PancakeNetworkUncacheConnection(PancakeNetworkConnectionCache **cache, PancakeSocket *sock);
+PANCAKE_API void PancakeNetworkExportListenSockets();
+PANCAKE_API UByte PancakeNetworkDrain(); /* returns 1 once the event loop may stop */
+PANCAKE_API void PancakeNetworkSetIdle(PancakeSocket *sock, UByte idle);
+PANCAKE_API void PancakeNetworkInitializeConnectionCache(PancakeNetworkConnectionCache *cache);
+PANCAKE_API void PancakeNetworkCacheConnection(PancakeNetworkConnectionCache *cache, PancakeSocket *socket);
+PANCAKE_API void PancakeNetworkUncacheConnection(PancakeNetworkConnectionCache *cache, PancakeSocket *sock);
+PANCAKE_API void PancakeNetworkSetTimeout(PancakeSocket *sock, UInt32 milliseconds, PancakeNetworkEventHandler onTimeout);
+PANCAKE_API void PancakeNetworkClearTimeout(PancakeSocket *sock);
+PANCAKE_API void PancakeNetworkOnConnect(PancakeSocket *sock, UInt32 timeout, PancakeNetworkConnectCallback callback); /* timeout in milliseconds */
+PANCAKE_API void PancakeNetworkSetHandlers(PancakeSocket *sock, PancakeNetworkEventHandler onRead, PancakeNetworkEventHandler onWrite, PancakeNetworkEventHandler onRemoteHangup); /* safe while a connect is pending */
 
 PANCAKE_API void PancakeNetworkRegisterNetworkLayer(PancakeNetworkLayer *layer);
 
+/* Makes room for size bytes keeping buffered data, buffers are taken from a per-worker pool */
+PANCAKE_API void PancakeNetworkBufferReserve(PancakeNetworkBuffer *buffer, UInt32 size);
+PANCAKE_API void PancakeNetworkBufferRelease(PancakeNetworkBuffer *buffer);
+
 /* NetworkTLS */
 #ifdef PANCAKE_NETWORK_TLS
 
@@ -160,4 +225,45 @@ void PancakeNetworkUnload();
 #define PANCAKE_NETWORK_CONNECTION_CACHE_KEEP 1
 #define PANCAKE_NETWORK_CONNECTION_CACHE_REMOVE 2
 
+/* Smallest network buffer size class, size classes double up to NetworkBuffering.Max */
+#define PANCAKE_NETWORK_BUFFER_MIN 2048
+
+/* Free buffers kept per size class unless using huge pages */
+#define PANCAKE_NETWORK_BUFFER_POOL_MAX_FREE 64
+
+/* Size of huge page chunks buffers are carved from */
+#define PANCAKE_NETWORK_BUFFER_CHUNK_SIZE (2 * 1024 * 1024)
+
+/* Environment variable passing listen sockets to the master replacing us on reload */
+#define PANCAKE_NETWORK_LISTEN_SOCKETS_ENV "PANCAKE_LISTEN_SOCKETS"
+
+/* Stream socket read by PancakeNetworkRead() only, the server architecture may transfer its data itself */
+#define PANCAKE_NETWORK_STREAM	1 << 20
+
+/* Client connection is waiting for further requests (keep-alive) */
+#define PANCAKE_NETWORK_IDLE	1 << 21
+
+/* Socket belongs to a connection cache */
+#define PANCAKE_NETWORK_CACHED	1 << 22
+
+/* Socket is still connecting to the remote host */
+#define PANCAKE_NETWORK_CONNECTING	1 << 23
+
+/* Socket is a connection accepted on a listen socket */
+#define PANCAKE_NETWORK_CLIENT	1 << 24
+
+/* Socket is a listen socket */
+#define PANCAKE_NETWORK_LISTEN	1 << 25
+
+/* Readiness of sockets, cleared when I/O would block (used by edge-triggered server architectures) */
+#define PANCAKE_NETWORK_READABLE	1 << 26
+#define PANCAKE_NETWORK_WRITABLE	1 << 27
+
+/* Accept modes of listen sockets */
+#define PANCAKE_NETWORK_ACCEPT_EXCLUSIVE	1 << 28
+#define PANCAKE_NETWORK_ACCEPT_REUSEPORT	1 << 29
+
+/* Listen socket was bound by this process instead of being inherited from the master we were reloaded from */
+#define PANCAKE_NETWORK_BOUND	1 << 30
+
 #endif
@@ -0,0 +1,71 @@
+#include "PancakePool.h"
+
+STATIC void PancakePoolAllocateSlab(PancakePool *pool) {
+	PancakePoolSlab *slab;
+	UByte *offset;
+	UInt32 i;
+
+	// Keep objects aligned to pointer size
+	pool->size = (pool->size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+	slab = PancakeAllocate(sizeof(PancakePoolSlab) + pool->size * pool->slabObjects);
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+
+	// Build free list in memory order for better locality
+	offset = (UByte*) (slab + 1) + pool->size * (pool->slabObjects - 1);
+
+	for(i = 0; i < pool->slabObjects; i++) {
+		PancakePoolObject *object = (PancakePoolObject*) offset;
+
+		object->next = pool->freeObjects;
+		pool->freeObjects = object;
+
+		offset -= pool->size;
+	}
+}
+
+PANCAKE_API inline void *PancakePoolAllocate(PancakePool *pool) {
+	PancakePoolObject *object;
+
+	if(UNEXPECTED(pool->freeObjects == NULL)) {
+		PancakePoolAllocateSlab(pool);
+	}
+
+	object = pool->freeObjects;
+	pool->freeObjects = object->next;
+
+	return (void*) object;
+}
+
+PANCAKE_API inline void PancakePoolFree(PancakePool *pool, void *ptr) {
+	PancakePoolObject *object = (PancakePoolObject*) ptr;
+
+	PancakeDebug {
+		// Make use after free more obvious
+		memset(ptr, 0xCC, pool->size);
+	}
+
+	object->next = pool->freeObjects;
+	pool->freeObjects = object;
+}
+
+PANCAKE_API void PancakePoolSetObjectSize(PancakePool *pool, UInt32 size) {
+	// Object size can't be changed after objects were allocated
+	PancakeAssert(pool->slabs == NULL);
+
+	if(size > pool->size) {
+		pool->size = size;
+	}
+}
+
+PANCAKE_API void PancakePoolDestroy(PancakePool *pool) {
+	PancakePoolSlab *slab, *tmp;
+
+	LL_FOREACH_SAFE(pool->slabs, slab, tmp) {
+		PancakeFree(slab);
+	}
+
+	pool->slabs = NULL;
+	pool->freeObjects = NULL;
+}
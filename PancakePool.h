@@ -0,0 +1,31 @@
+
+#ifndef _PANCAKE_POOL_H
+#define _PANCAKE_POOL_H
+
+#include "Pancake.h"
+
+typedef struct _PancakePoolSlab {
+	struct _PancakePoolSlab *next;
+} PancakePoolSlab;
+
+typedef struct _PancakePoolObject {
+	struct _PancakePoolObject *next;
+} PancakePoolObject;
+
+typedef struct _PancakePool {
+	UInt32 size; /* object size */
+	UInt32 slabObjects; /* objects per slab */
+
+	PancakePoolObject *freeObjects;
+	PancakePoolSlab *slabs;
+} PancakePool;
+
+/* Static initializer, slabs are allocated on first use in each worker */
+#define PancakePoolInitializer(size, slabObjects) {size, slabObjects, NULL, NULL}
+
+PANCAKE_API void *PancakePoolAllocate(PancakePool *pool);
+PANCAKE_API void PancakePoolFree(PancakePool *pool, void *ptr);
+PANCAKE_API void PancakePoolSetObjectSize(PancakePool *pool, UInt32 size);
+PANCAKE_API void PancakePoolDestroy(PancakePool *pool);
+
+#endif
@@ -1,136 +1,371 @@
 #include "PancakeScheduler.h"
+#include "PancakeDateTime.h"
+#include "PancakeStatistics.h"
 
-static PancakeSchedulerEvent *events = NULL; /* waiting events */
+/* Hierarchical timing wheel, each level has PANCAKE_SCHEDULER_SLOTS slots covering PANCAKE_SCHEDULER_SLOTS times the range of a slot of the level below */
+#define PANCAKE_SCHEDULER_BITS 6
+#define PANCAKE_SCHEDULER_SLOTS (1 << PANCAKE_SCHEDULER_BITS)
+#define PANCAKE_SCHEDULER_MASK (PANCAKE_SCHEDULER_SLOTS - 1)
+#define PANCAKE_SCHEDULER_LEVELS 5
+
+/* Events further in the future are kept in the last level and cascaded again */
+#define PANCAKE_SCHEDULER_HORIZON ((UInt64) 1 << (PANCAKE_SCHEDULER_BITS * PANCAKE_SCHEDULER_LEVELS))
+
+/* Special levels of events not stored in the wheel */
+#define PANCAKE_SCHEDULER_EXPIRED 0xFE
+#define PANCAKE_SCHEDULER_RUNNING 0xFF
+
+static PancakeSchedulerEvent *wheel[PANCAKE_SCHEDULER_LEVELS][PANCAKE_SCHEDULER_SLOTS];
+static UInt64 occupiedSlots[PANCAKE_SCHEDULER_LEVELS]; /* bitmap of non-empty slots per level */
+static UInt32 numLevelEvents[PANCAKE_SCHEDULER_LEVELS];
+static UInt32 numEvents = 0;
+static UInt64 wheelTime = 0; /* next millisecond to be processed */
+
+static PancakeSchedulerEvent *expiredEvents = NULL; /* events being run by PancakeSchedulerRun */
 static PancakeSchedulerEvent *unusedEvents = NULL; /* cached event instances */
+static UInt32 numUnusedEvents = 0;
+static UByte shuttingDown = 0;
 
-PANCAKE_API PancakeSchedulerEvent *PancakeSchedule(UNative time, PancakeSchedulerEventCallback callback, void *arg) {
+STATIC inline UByte PancakeSchedulerFirstSlot(UInt64 slots, UByte offset) {
+	// Rotate bitmap so that offset becomes the lowest bit
+	if(offset) {
+		slots = (slots >> offset) | (slots << (PANCAKE_SCHEDULER_SLOTS - offset));
+	}
+
+#if defined(__GNUC__)
+	return (UByte) __builtin_ctzll(slots);
+#else
+	{
+		UByte i = 0;
+
+		while(!(slots & 1)) {
+			slots >>= 1;
+			i++;
+		}
+
+		return i;
+	}
+#endif
+}
+
+STATIC inline UInt64 PancakeSchedulerNow() {
+	// Monotonic clock is not affected by wall-clock changes
+	return PancakeNowMilliseconds();
+}
+
+STATIC void PancakeSchedulerInsert(PancakeSchedulerEvent *event) {
+	UInt64 time = event->time;
+	UInt64 delta;
+	UByte level = 0;
+
+	// Time has already been processed, run event as soon as possible
+	if(time < wheelTime) {
+		event->level = PANCAKE_SCHEDULER_EXPIRED;
+		DL_APPEND(expiredEvents, event);
+		return;
+	}
+
+	delta = time - wheelTime;
+
+	if(UNEXPECTED(delta >= PANCAKE_SCHEDULER_HORIZON)) {
+		time = wheelTime + PANCAKE_SCHEDULER_HORIZON - 1;
+		delta = PANCAKE_SCHEDULER_HORIZON - 1;
+	}
+
+	// Find level covering the distance to the event
+	while(delta >= PANCAKE_SCHEDULER_SLOTS) {
+		delta >>= PANCAKE_SCHEDULER_BITS;
+		level++;
+	}
+
+	event->level = level;
+	event->slot = (time >> (level * PANCAKE_SCHEDULER_BITS)) & PANCAKE_SCHEDULER_MASK;
+
+	DL_APPEND(wheel[level][event->slot], event);
+	occupiedSlots[level] |= (UInt64) 1 << event->slot;
+	numLevelEvents[level]++;
+}
+
+STATIC void PancakeSchedulerRemove(PancakeSchedulerEvent *event) {
+	DL_DELETE(wheel[event->level][event->slot], event);
+	numLevelEvents[event->level]--;
+
+	if(wheel[event->level][event->slot] == NULL) {
+		occupiedSlots[event->level] &= ~((UInt64) 1 << event->slot);
+	}
+}
+
+STATIC UByte PancakeSchedulerCascade(UByte level) {
+	UByte slot = (wheelTime >> (level * PANCAKE_SCHEDULER_BITS)) & PANCAKE_SCHEDULER_MASK;
+	PancakeSchedulerEvent *events = wheel[level][slot], *event, *tmp;
+
+	wheel[level][slot] = NULL;
+	occupiedSlots[level] &= ~((UInt64) 1 << slot);
+
+	// Events move to lower levels now that they are closer
+	DL_FOREACH_SAFE(events, event, tmp) {
+		numLevelEvents[level]--;
+		PancakeSchedulerInsert(event);
+	}
+
+	return slot;
+}
+
+STATIC void PancakeSchedulerRecycle(PancakeSchedulerEvent *event) {
+	numEvents--;
+
+	// Keep a limited amount of event instances for later use
+	if(numUnusedEvents >= PANCAKE_SCHEDULER_MAX_UNUSED_EVENTS) {
+		PancakeFree(event);
+		return;
+	}
+
+	event->next = unusedEvents;
+	unusedEvents = event;
+	numUnusedEvents++;
+}
+
+PANCAKE_API PancakeSchedulerEvent *PancakeScheduleIn(UInt32 milliseconds, PancakeSchedulerEventCallback callback, void *arg) {
 	PancakeSchedulerEvent *event;
+	UInt64 now = PancakeSchedulerNow();
 
 	if(unusedEvents) {
 		// Use cached event instance
 		event = unusedEvents;
-
-		CDL_DELETE(unusedEvents, unusedEvents);
+		unusedEvents = event->next;
+		numUnusedEvents--;
 	} else {
 		// Allocate new event
 		event = PancakeAllocate(sizeof(PancakeSchedulerEvent));
 	}
 
-	event->time = time;
+	// Wheel can be moved freely while it is empty
+	if(!numEvents) {
+		wheelTime = now;
+	}
+
+	event->time = now + milliseconds;
 	event->callback = callback;
 	event->arg = arg;
 
-	if(events) {
-		if(events->prev->time <= time) {
-			CDL_PREPEND_ELEM(events, events, event);
-
-			events = event->next;
-		} else if(events->time >= time) {
-			CDL_PREPEND(events, event);
-		} else {
-			PancakeSchedulerEvent *ev;
-
-			// Iterate through events and find place for new event
-			CDL_FOREACH(events, ev) {
-				if(ev->time == time) {
-					CDL_PREPEND_ELEM(events, ev->next, event);
-					break;
-				} else if(ev->time < time && ev->next->time >= time) {
-					CDL_PREPEND_ELEM(events, ev->next, event);
-					break;
-				}
-			}
-		}
-	} else {
-		CDL_PREPEND(events, event);
+	PancakeSchedulerInsert(event);
+	numEvents++;
+
+	return event;
+}
+
+STATIC inline UInt32 PancakeSchedulerMillisecondsUntil(UNative when) {
+	UNative now = PancakeNow();
+
+	if(when <= now) {
+		return 0;
 	}
 
-	PancakeDebug {
-		// Check for event order corruption
-		PancakeSchedulerEvent *ev;
-		UByte haveScheduledEvent = 0;
+	return when - now >= UINT_MAX / 1000 ? UINT_MAX : (when - now) * 1000;
+}
 
-		CDL_FOREACH(events, ev) {
-			if(ev->next != events) {
-				PancakeAssert(ev->time <= ev->next->time);
-			}
+PANCAKE_API PancakeSchedulerEvent *PancakeSchedule(UNative time, PancakeSchedulerEventCallback callback, void *arg) {
+	return PancakeScheduleIn(PancakeSchedulerMillisecondsUntil(time), callback, arg);
+}
 
-			if(ev == event) {
-				haveScheduledEvent++;
-			}
+PANCAKE_API extern inline void PancakeUnschedule(PancakeSchedulerEvent *event) {
+	switch(event->level) {
+		case PANCAKE_SCHEDULER_RUNNING:
+			// Event is recycled after running its callback
+			return;
+		case PANCAKE_SCHEDULER_EXPIRED:
+			DL_DELETE(expiredEvents, event);
+			break;
+		default:
+			PancakeSchedulerRemove(event);
+			break;
+	}
+
+	PancakeSchedulerRecycle(event);
+}
+
+STATIC UInt64 PancakeSchedulerGetNextTime() {
+	UInt64 next = 0;
+	UByte level;
+
+	if(!numEvents) {
+		return 0;
+	}
+
+	if(expiredEvents) {
+		return expiredEvents->time;
+	}
+
+	if(occupiedSlots[0]) {
+		// Events in the first level are due at the time of their slot
+		next = wheelTime + PancakeSchedulerFirstSlot(occupiedSlots[0], wheelTime & PANCAKE_SCHEDULER_MASK);
+	}
+
+	for(level = 1; level < PANCAKE_SCHEDULER_LEVELS; level++) {
+		UByte shift = level * PANCAKE_SCHEDULER_BITS;
+		UInt64 position, time;
+
+		if(!occupiedSlots[level]) {
+			continue;
 		}
 
-		PancakeAssert(haveScheduledEvent == 1);
+		// Events of higher levels are not due before their slot is cascaded, the current slot is cascaded when wheel time is at its start
+		position = wheelTime >> shift;
+
+		if(wheelTime & (((UInt64) 1 << shift) - 1)) {
+			position++;
+		}
+
+		time = (position + PancakeSchedulerFirstSlot(occupiedSlots[level], position & PANCAKE_SCHEDULER_MASK)) << shift;
+
+		if(!next || time < next) {
+			next = time;
+		}
 	}
 
-	return event;
+	return next;
 }
 
-PANCAKE_API extern inline void PancakeUnschedule(PancakeSchedulerEvent *event) {
-	CDL_DELETE(events, event);
-	CDL_PREPEND(unusedEvents, event);
-}
+PANCAKE_API UInt32 PancakeSchedulerGetNextExecutionTimeOffsetMilliseconds() {
+	UInt64 now, next;
 
-PANCAKE_API extern inline UNative PancakeSchedulerGetNextExecutionTime() {
-	if(!events) {
-		return time(NULL) + 86400;
+	if(!numEvents) {
+		return 86400000;
 	}
 
-	return events->time < time(NULL) ? time(NULL) : events->time;
+	now = PancakeSchedulerNow();
+	next = PancakeSchedulerGetNextTime();
+
+	return next < now ? 0 : next - now;
 }
 
 PANCAKE_API extern inline UNative PancakeSchedulerGetNextExecutionTimeOffset() {
-	UNative now;
+	// Round up to avoid waking up before events are due
+	return (PancakeSchedulerGetNextExecutionTimeOffsetMilliseconds() + 999) / 1000;
+}
+
+PANCAKE_API extern inline UNative PancakeSchedulerGetNextExecutionTime() {
+	return PancakeNow() + PancakeSchedulerGetNextExecutionTimeOffset();
+}
 
-	if(!events) {
-		return 86400;
+PANCAKE_API UNative PancakeSchedulerGetNextScheduledTime() {
+	Int64 offset;
+
+	if(!numEvents) {
+		return 0;
 	}
 
-	now = time(NULL);
+	offset = (Int64) PancakeSchedulerGetNextTime() - (Int64) PancakeSchedulerNow();
 
-	return events->time < now ? 0 : events->time - now;
+	return PancakeNow() + offset / 1000;
 }
 
-PANCAKE_API extern inline UNative PancakeSchedulerGetNextScheduledTime() {
-	if(!events) {
-		return 0;
+STATIC void PancakeSchedulerRunExpiredEvents() {
+	while(expiredEvents) {
+		PancakeSchedulerEvent *event = expiredEvents;
+
+		DL_DELETE(expiredEvents, event);
+		event->level = PANCAKE_SCHEDULER_RUNNING;
+
+		// Run event
+		event->callback(event->arg);
+
+		// Cache event instance
+		PancakeSchedulerRecycle(event);
 	}
+}
 
-	return events->time;
+PANCAKE_API UByte PancakeSchedulerIsShuttingDown() {
+	return shuttingDown;
 }
 
 PANCAKE_API void PancakeSchedulerRun() {
-	PancakeSchedulerEvent *ev, *tmp, *tmp2;
-	UNative now = time(NULL);
+	UInt64 now = PancakeSchedulerNow();
 
-	CDL_FOREACH_SAFE(events, ev, tmp, tmp2) {
-		if(ev->time > now) {
-			break;
+	PancakeStatisticsSet(scheduledEvents, numEvents);
+
+	PancakeSchedulerRunExpiredEvents();
+
+	while(wheelTime <= now) {
+		UByte slot = wheelTime & PANCAKE_SCHEDULER_MASK, level;
+
+		if(!numEvents) {
+			wheelTime = now;
+			return;
 		}
 
-		// Run event
-		ev->callback(ev->arg);
+		// Move events of higher levels down when reaching their range
+		for(level = 1; !slot && level < PANCAKE_SCHEDULER_LEVELS; level++) {
+			slot = PancakeSchedulerCascade(level);
+		}
 
-		// Cache event instance
-		CDL_DELETE(events, ev);
-		CDL_PREPEND(unusedEvents, ev);
+		slot = wheelTime & PANCAKE_SCHEDULER_MASK;
+
+		if(!numLevelEvents[0]) {
+			// Skip to the next cascade
+			wheelTime = (wheelTime | PANCAKE_SCHEDULER_MASK) + 1;
+
+			if(wheelTime > now) {
+				wheelTime = now + 1;
+			}
+
+			continue;
+		}
+
+		if(wheel[0][slot]) {
+			PancakeSchedulerEvent *event;
+
+			DL_FOREACH(wheel[0][slot], event) {
+				event->level = PANCAKE_SCHEDULER_EXPIRED;
+				numLevelEvents[0]--;
+			}
+
+			DL_CONCAT(expiredEvents, wheel[0][slot]);
+			wheel[0][slot] = NULL;
+			occupiedSlots[0] &= ~((UInt64) 1 << slot);
+		}
+
+		// Events scheduled by callbacks for this time are expired already
+		wheelTime++;
+
+		PancakeSchedulerRunExpiredEvents();
 	}
 }
 
 void PancakeSchedulerShutdown() {
-	PancakeSchedulerEvent *ev, *tmp, *tmp2;
+	UByte level, slot;
+
+	shuttingDown = 1;
+
+	// Callbacks might schedule further events
+	while(numEvents) {
+		PancakeSchedulerRunExpiredEvents();
 
-	CDL_FOREACH_SAFE(events, ev, tmp, tmp2) {
-		// Run all events, no matter when they are scheduled
-		ev->callback(ev->arg);
+		for(level = 0; level < PANCAKE_SCHEDULER_LEVELS; level++) {
+			for(slot = 0; slot < PANCAKE_SCHEDULER_SLOTS; slot++) {
+				while(wheel[level][slot]) {
+					PancakeSchedulerEvent *event = wheel[level][slot];
 
-		CDL_DELETE(events, ev);
-		PancakeFree(ev);
+					PancakeSchedulerRemove(event);
+					event->level = PANCAKE_SCHEDULER_RUNNING;
+
+					// Run all events, no matter when they are scheduled
+					event->callback(event->arg);
+
+					numEvents--;
+					PancakeFree(event);
+				}
+			}
+		}
 	}
 
 	// Free cached events
-	CDL_FOREACH_SAFE(unusedEvents, ev, tmp, tmp2) {
-		CDL_DELETE(unusedEvents, ev);
-		PancakeFree(ev);
+	while(unusedEvents) {
+		PancakeSchedulerEvent *event = unusedEvents;
+
+		unusedEvents = event->next;
+		PancakeFree(event);
 	}
+
+	numUnusedEvents = 0;
 }
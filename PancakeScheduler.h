@@ -3,23 +3,33 @@
 
 #include "Pancake.h"
 
+/* Maximum amount of cached event instances */
+#define PANCAKE_SCHEDULER_MAX_UNUSED_EVENTS 1024
+
 typedef void (*PancakeSchedulerEventCallback)(void *arg);
 
 typedef struct _PancakeSchedulerEvent {
-	UNative time;
+	UInt64 time; /* milliseconds of monotonic clock */
 	PancakeSchedulerEventCallback callback;
 	void *arg;
 
+	/* Position in timing wheel */
+	UByte level;
+	UByte slot;
+
 	struct _PancakeSchedulerEvent *prev;
 	struct _PancakeSchedulerEvent *next;
 } PancakeSchedulerEvent;
 
-PANCAKE_API PancakeSchedulerEvent *PancakeSchedule(UNative time, PancakeSchedulerEventCallback callback, void *arg);
+PANCAKE_API PancakeSchedulerEvent *PancakeScheduleIn(UInt32 milliseconds, PancakeSchedulerEventCallback callback, void *arg);
+PANCAKE_API PancakeSchedulerEvent *PancakeSchedule(UNative time, PancakeSchedulerEventCallback callback, void *arg); /* time as returned by time() */
 PANCAKE_API void PancakeUnschedule(PancakeSchedulerEvent *event);
 PANCAKE_API UNative PancakeSchedulerGetNextExecutionTime(); /* returns >= time() */
 PANCAKE_API UNative PancakeSchedulerGetNextExecutionTimeOffset(); /* return >= 0 */
+PANCAKE_API UInt32 PancakeSchedulerGetNextExecutionTimeOffsetMilliseconds(); /* return >= 0 */
 PANCAKE_API UNative PancakeSchedulerGetNextScheduledTime(); /* returns actual scheduled time (can be < time()) */
 PANCAKE_API void PancakeSchedulerRun();
+PANCAKE_API UByte PancakeSchedulerIsShuttingDown(); /* events are run regardless of their time */
 
 void PancakeSchedulerShutdown();
 
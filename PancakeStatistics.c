@@ -0,0 +1,78 @@
+#include "PancakeStatistics.h"
+#include "PancakeLogger.h"
+
+/* Counters of processes not attached to a slot are dropped here */
+static PancakeStatistics unattachedStatistics;
+
+PancakeStatistics *PancakeCurrentStatistics = &unattachedStatistics;
+
+static PancakeStatisticsSlot *slots = NULL;
+static UInt16 numSlots = 0;
+
+PANCAKE_API void PancakeStatisticsInitialize(UInt16 amount) {
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+	void *segment = mmap(NULL, amount * sizeof(PancakeStatisticsSlot), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+	if(segment == MAP_FAILED) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't create shared statistics segment: %s", strerror(errno));
+		return;
+	}
+
+	// Anonymous mappings are zero-filled
+	slots = (PancakeStatisticsSlot*) segment;
+	numSlots = amount;
+#else
+	PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Shared statistics are not supported on this system");
+#endif
+}
+
+PANCAKE_API void PancakeStatisticsAttach(UInt16 slot) {
+	if(slot >= numSlots) {
+		return;
+	}
+
+	PancakeCurrentStatistics = &slots[slot].statistics;
+
+	// Gauges of a crashed worker are stale
+	PancakeStatisticsSet(activeConnections, 0);
+	PancakeStatisticsSet(scheduledEvents, 0);
+}
+
+PANCAKE_API void PancakeStatisticsAggregate(PancakeStatistics *total) {
+	UInt16 i;
+	UByte j;
+
+	memset(total, 0, sizeof(PancakeStatistics));
+
+	for(i = 0; i < numSlots; i++) {
+		PancakeStatistics *statistics = &slots[i].statistics;
+
+		total->acceptedConnections += PancakeStatisticsGet(statistics, acceptedConnections);
+		total->activeConnections += PancakeStatisticsGet(statistics, activeConnections);
+		total->keepAliveReuses += PancakeStatisticsGet(statistics, keepAliveReuses);
+		total->bytesIn += PancakeStatisticsGet(statistics, bytesIn);
+		total->bytesOut += PancakeStatisticsGet(statistics, bytesOut);
+		total->upstreamErrors += PancakeStatisticsGet(statistics, upstreamErrors);
+		total->scheduledEvents += PancakeStatisticsGet(statistics, scheduledEvents);
+
+		for(j = 0; j < sizeof(total->requests) / sizeof(UInt64); j++) {
+			total->requests[j] += PancakeStatisticsGet(statistics, requests[j]);
+		}
+
+		for(j = 0; j < sizeof(total->answers) / sizeof(UInt64); j++) {
+			total->answers[j] += PancakeStatisticsGet(statistics, answers[j]);
+		}
+	}
+}
+
+void PancakeStatisticsShutdown() {
+#if defined(HAVE_SYS_MMAN_H) && defined(MAP_ANONYMOUS)
+	if(slots) {
+		munmap(slots, numSlots * sizeof(PancakeStatisticsSlot));
+	}
+#endif
+
+	slots = NULL;
+	numSlots = 0;
+	PancakeCurrentStatistics = &unattachedStatistics;
+}
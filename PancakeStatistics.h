@@ -0,0 +1,49 @@
+
+#ifndef _PANCAKE_STATISTICS_H
+#define _PANCAKE_STATISTICS_H
+
+#include "Pancake.h"
+
+/* Size of the cache lines slots are aligned to, keeps workers from invalidating each other's slots */
+#define PANCAKE_STATISTICS_CACHE_LINE 64
+
+typedef struct _PancakeStatistics {
+	UInt64 acceptedConnections;
+	UInt64 activeConnections;
+	UInt64 keepAliveReuses;
+	UInt64 bytesIn;
+	UInt64 bytesOut;
+	UInt64 requests[3]; /* by method, PANCAKE_HTTP_GET - 1 to PANCAKE_HTTP_HEAD - 1 */
+	UInt64 answers[5]; /* by status class, 1xx to 5xx */
+	UInt64 upstreamErrors;
+	UInt64 scheduledEvents;
+} PancakeStatistics;
+
+typedef union _PancakeStatisticsSlot {
+	PancakeStatistics statistics;
+	UByte padding[(sizeof(PancakeStatistics) + PANCAKE_STATISTICS_CACHE_LINE - 1) & ~(PANCAKE_STATISTICS_CACHE_LINE - 1)];
+} PancakeStatisticsSlot;
+
+extern PancakeStatistics *PancakeCurrentStatistics;
+
+/* Each slot is only written by its own worker, relaxed stores are enough to never show torn values */
+#if defined(__GNUC__)
+#	define PancakeStatisticsAdd(field, value) __atomic_store_n(&PancakeCurrentStatistics->field, __atomic_load_n(&PancakeCurrentStatistics->field, __ATOMIC_RELAXED) + (value), __ATOMIC_RELAXED)
+#	define PancakeStatisticsSet(field, value) __atomic_store_n(&PancakeCurrentStatistics->field, (value), __ATOMIC_RELAXED)
+#	define PancakeStatisticsGet(statistics, field) __atomic_load_n(&(statistics)->field, __ATOMIC_RELAXED)
+#else
+#	define PancakeStatisticsAdd(field, value) (PancakeCurrentStatistics->field += (value))
+#	define PancakeStatisticsSet(field, value) (PancakeCurrentStatistics->field = (value))
+#	define PancakeStatisticsGet(statistics, field) ((statistics)->field)
+#endif
+
+#define PancakeStatisticsIncrement(field) PancakeStatisticsAdd(field, 1)
+#define PancakeStatisticsDecrement(field) PancakeStatisticsAdd(field, -1)
+
+/* Segment is created by the master before forking and shared by all workers */
+PANCAKE_API void PancakeStatisticsInitialize(UInt16 numSlots);
+PANCAKE_API void PancakeStatisticsAttach(UInt16 slot);
+PANCAKE_API void PancakeStatisticsAggregate(PancakeStatistics *total);
+void PancakeStatisticsShutdown();
+
+#endif
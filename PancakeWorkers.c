@@ -1,10 +1,218 @@
 
 #include "PancakeWorkers.h"
 #include "PancakeLogger.h"
+#include "PancakeDateTime.h"
+#include "PancakeScheduler.h"
+#include "PancakeStatistics.h"
 
-/* Forward declaration */
+#include <poll.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/* Forward declarations */
 STATIC void PancakeInternalCommunicationEvent(PancakeSocket *sock);
 
+/* CPUs workers are pinned to, in order of worker ids */
+static Int32 *affinityCPUs = NULL;
+static UInt16 numAffinityCPUs = 0;
+
+/* Time and CPU time of the last load report of this worker in milliseconds */
+static UInt64 lastLoadReportTime = 0;
+static UInt64 lastLoadReportCPUTime = 0;
+
+/* Master running the new configuration while reloading, it tells us to stop once its workers run */
+static pid_t reloadPid = 0;
+static Int32 reloadSocket = -1;
+
+/* Signals the supervising master only receives while waiting */
+STATIC void PancakeGetSupervisorSignals(sigset_t *signalSet) {
+	sigemptyset(signalSet);
+	sigaddset(signalSet, SIGCHLD);
+	sigaddset(signalSet, SIGINT);
+	sigaddset(signalSet, SIGTERM);
+	sigaddset(signalSet, SIGHUP);
+}
+
+UByte PancakeWorkersAmountConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	if(step == PANCAKE_CONFIGURATION_INIT) {
+		switch(setting->type) {
+			case CONFIG_TYPE_INT:
+				return 1;
+			case CONFIG_TYPE_STRING:
+				if(!strcmp(setting->value.sval, "auto")) {
+					Native numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+
+					free(setting->value.sval);
+
+					// One worker per online CPU
+					setting->type = CONFIG_TYPE_INT;
+					setting->value.ival = numCPUs > 0 ? numCPUs : 1;
+					return 1;
+				}
+				break;
+		}
+
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "%s must be a number or \"auto\"", setting->name);
+		return 0;
+	}
+
+	return 1;
+}
+
+STATIC void PancakeWorkersAddAffinityCPU(Int32 cpu) {
+	affinityCPUs = PancakeReallocate(affinityCPUs, (numAffinityCPUs + 1) * sizeof(Int32));
+	affinityCPUs[numAffinityCPUs++] = cpu;
+}
+
+UByte PancakeWorkersCPUAffinityConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope) {
+	switch(step) {
+		case PANCAKE_CONFIGURATION_INIT: {
+#ifdef CPU_SET
+			Byte *offset = setting->value.sval;
+
+			PancakeAssert(setting->type == CONFIG_TYPE_STRING);
+
+			if(!*offset) {
+				// No placement requested
+			} else if(!strcmp(offset, "auto")) {
+				cpu_set_t set;
+				Int32 cpu;
+
+				// Spread workers over the CPUs the master may run on
+				if(sched_getaffinity(0, sizeof(cpu_set_t), &set) == -1) {
+					PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't determine available CPUs: %s", strerror(errno));
+					return 0;
+				}
+
+				for(cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+					if(CPU_ISSET(cpu, &set)) {
+						PancakeWorkersAddAffinityCPU(cpu);
+					}
+				}
+			} else {
+				// List of CPUs and CPU ranges, e.g. "0,2,4-7"
+				while(*offset) {
+					Byte *end;
+					long first, last;
+
+					first = last = strtol(offset, &end, 10);
+
+					if(end != offset && *end == '-') {
+						offset = end + 1;
+						last = strtol(offset, &end, 10);
+					}
+
+					if(end == offset || (*end && *end != ',') || first < 0 || last < first || last >= CPU_SETSIZE) {
+						PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Invalid CPU list \"%s\"", setting->value.sval);
+						return 0;
+					}
+
+					for(; first <= last; first++) {
+						PancakeWorkersAddAffinityCPU(first);
+					}
+
+					offset = *end ? end + 1 : end;
+				}
+			}
+
+			// Free some memory
+			free(setting->value.sval);
+			setting->type = CONFIG_TYPE_NONE;
+#else
+			if(*setting->value.sval) {
+				PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "CPUAffinity is not supported on this system");
+				return 0;
+			}
+#endif
+		} break;
+		case PANCAKE_CONFIGURATION_DTOR:
+			if(affinityCPUs) {
+				PancakeFree(affinityCPUs);
+				affinityCPUs = NULL;
+				numAffinityCPUs = 0;
+			}
+			break;
+	}
+
+	return 1;
+}
+
+STATIC void PancakeWorkersApplyAffinity(PancakeWorker *worker) {
+#ifdef CPU_SET
+	cpu_set_t set;
+
+	if(!numAffinityCPUs) {
+		return;
+	}
+
+	// Pin worker before it allocates anything so that memory is placed on its local node
+	CPU_ZERO(&set);
+	CPU_SET(affinityCPUs[worker->id % numAffinityCPUs], &set);
+
+	if(sched_setaffinity(0, sizeof(cpu_set_t), &set) == -1) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't pin worker to CPU %i: %s", affinityCPUs[worker->id % numAffinityCPUs], strerror(errno));
+		return;
+	}
+
+	worker->cpu = affinityCPUs[worker->id % numAffinityCPUs];
+#endif
+}
+
+STATIC UInt64 PancakeWorkerCPUTime() {
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+
+	return ((UInt64) usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000;
+}
+
+STATIC void PancakeReportLoad(void *arg) {
+	UInt64 now, CPUTime;
+	UByte message[2];
+
+	// Scheduler runs all remaining events on shutdown
+	if(PancakeDoShutdown) {
+		return;
+	}
+
+	now = PancakeNowMilliseconds();
+	CPUTime = PancakeWorkerCPUTime();
+
+	// Time spent on CPU is the time the event loop was busy
+	message[0] = PANCAKE_WORKER_LOAD_INT;
+	message[1] = now > lastLoadReportTime ? (CPUTime - lastLoadReportCPUTime) * 100 / (now - lastLoadReportTime) : 0;
+
+	if(message[1] > 100) {
+		message[1] = 100;
+	}
+
+	write(PancakeCurrentWorker->workerSocket.fd, message, sizeof(message));
+
+	lastLoadReportTime = now;
+	lastLoadReportCPUTime = CPUTime;
+
+	PancakeScheduleIn(PANCAKE_WORKER_LOAD_INTERVAL * 1000, PancakeReportLoad, NULL);
+}
+
+PANCAKE_API PancakeWorker *PancakeCreateWorker(UInt16 id) {
+	PancakeWorker *worker = PancakeAllocate(sizeof(PancakeWorker));
+
+	worker->name.value = PancakeAllocate(sizeof("Worker #65535"));
+	worker->name.length = sprintf(worker->name.value, "Worker #%i", id + 1);
+	worker->run = PancakeMainConfiguration.serverArchitecture->runServer;
+	worker->isMaster = 0;
+	worker->id = id;
+	worker->cpu = -1;
+	worker->masterSocket = -1;
+	worker->numCrashes = 0;
+	worker->load = 0;
+	worker->receivingLoad = 0;
+	worker->retiring = 0;
+
+	return worker;
+}
+
 PANCAKE_API UByte PancakeRunWorker(PancakeWorker *worker) {
 	pid_t pid;
 	Int32 sockets[2];
@@ -25,21 +233,76 @@ PANCAKE_API UByte PancakeRunWorker(PancakeWorker *worker) {
 
 	if(pid == -1) {
 		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't fork: %s", strerror(errno));
+
+		close(sockets[0]);
+		close(sockets[1]);
+		worker->masterSocket = -1;
 		return 0;
 	} else if(pid) {
 		/* Master */
 
+		close(sockets[1]);
+
+		PancakeUpdateNow();
+
 		worker->pid = pid;
+		worker->startTime = PancakeNow();
+		worker->respawnTime = 0;
+		worker->heartbeatTime = worker->startTime;
+		worker->heartbeatPending = 0;
+		worker->load = 0;
+		worker->receivingLoad = 0;
 		return 1;
 	} else {
 		/* Child */
+		sigset_t signalSet;
+		UInt16 i;
+
+		close(sockets[0]);
+
+		// Don't keep sockets of other workers open
+		for(i = 0; i < PancakeMainConfiguration.maxWorkers; i++) {
+			if(PancakeWorkerRegistry[i] && PancakeWorkerRegistry[i] != worker && PancakeWorkerRegistry[i]->masterSocket != -1) {
+				close(PancakeWorkerRegistry[i]->masterSocket);
+			}
+		}
+
+		if(reloadSocket != -1) {
+			close(reloadSocket);
+		}
+
+		// Previous master must notice when we fail to start
+		PancakeClosePreviousMaster(0);
+
+		// Worker is freed separately on shutdown
+		if(PancakeWorkerRegistry[worker->id] == worker) {
+			PancakeWorkerRegistry[worker->id] = NULL;
+		}
+
+		// Supervising master blocks signals while it is not waiting
+		PancakeGetSupervisorSignals(&signalSet);
+		sigprocmask(SIG_UNBLOCK, &signalSet, NULL);
 
 		worker->pid = getpid();
+
+		// Count into the shared slot of this worker
+		PancakeStatisticsAttach(worker->id);
+
 		PancakeCurrentWorker = worker;
 
+		PancakeWorkersApplyAffinity(worker);
+
 		// Register communication socket
 		PancakeNetworkAddReadSocket(&worker->workerSocket);
 
+		// Tell the master about our load so that it can scale the amount of workers
+		if(PancakeMainConfiguration.maxWorkers > PancakeMainConfiguration.workers) {
+			lastLoadReportTime = PancakeNowMilliseconds();
+			lastLoadReportCPUTime = PancakeWorkerCPUTime();
+
+			PancakeScheduleIn(PANCAKE_WORKER_LOAD_INTERVAL * 1000, PancakeReportLoad, NULL);
+		}
+
 		PancakeDebug {
 			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "PID: %i", worker->pid);
 		}
@@ -51,14 +314,538 @@ PANCAKE_API UByte PancakeRunWorker(PancakeWorker *worker) {
 }
 
 STATIC void PancakeInternalCommunicationEvent(PancakeSocket *sock) {
+	UByte instructions[16];
+	ssize_t length, i;
+
+	// Instructions are single bytes, handle all of them that arrived meanwhile
+	length = read(sock->fd, instructions, sizeof(instructions));
+
+	sock->flags &= ~(PANCAKE_NETWORK_READABLE);
+
+	if(length <= 0) {
+		// Master is gone, stop polling the closed socket while draining
+		PancakeNetworkRemoveReadSocket(sock);
+		PancakeDoShutdown = 1;
+		return;
+	}
+
+	for(i = 0; i < length; i++) {
+		switch(instructions[i]) {
+			case PANCAKE_WORKER_HEARTBEAT_INT:
+				// Tell the master our event loop is still running
+				write(sock->fd, PANCAKE_WORKER_HEARTBEAT, sizeof(PANCAKE_WORKER_HEARTBEAT) - 1);
+				break;
+			default:
+			case PANCAKE_WORKER_GRACEFUL_SHUTDOWN_INT:
+				PancakeDoShutdown = 1;
+				break;
+		}
+	}
+}
+
+STATIC PancakeWorker *PancakeLookupWorker(pid_t pid) {
+	UInt16 i;
+
+	for(i = 0; i < PancakeMainConfiguration.maxWorkers; i++) {
+		if(PancakeWorkerRegistry[i] && PancakeWorkerRegistry[i]->pid == pid) {
+			return PancakeWorkerRegistry[i];
+		}
+	}
+
+	return NULL;
+}
+
+STATIC void PancakeScheduleWorkerRespawn(PancakeWorker *worker) {
+	UNative now = PancakeNow();
+	UInt32 delay = 0;
+
+	if(worker->masterSocket != -1) {
+		close(worker->masterSocket);
+		worker->masterSocket = -1;
+	}
+
+	// Back off exponentially while the worker keeps crashing right after its start
+	if(now - worker->startTime < PANCAKE_WORKER_CRASH_INTERVAL) {
+		if(worker->numCrashes < 16) {
+			worker->numCrashes++;
+		}
+
+		delay = 1 << (worker->numCrashes - 1);
+
+		if(delay > PANCAKE_WORKER_MAX_RESPAWN_DELAY) {
+			delay = PANCAKE_WORKER_MAX_RESPAWN_DELAY;
+		}
+	} else {
+		worker->numCrashes = 0;
+	}
+
+	worker->pid = 0;
+	worker->respawnTime = now + delay;
+
+	if(delay) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "%s keeps crashing, running it again in %u seconds", worker->name.value, delay);
+	}
+}
+
+STATIC void PancakeReapWorkers() {
+	pid_t pid;
+	Int32 status;
+
+	while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+		PancakeWorker *worker = PancakeLookupWorker(pid);
+
+		if(worker == NULL) {
+			continue;
+		}
+
+		// Worker was stopped since the load decreased
+		if(worker->retiring && WIFEXITED(status) && !WEXITSTATUS(status)) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "%s retired", worker->name.value);
+
+			close(worker->masterSocket);
+			PancakeWorkerRegistry[worker->id] = NULL;
+
+			PancakeFree(worker->name.value);
+			PancakeFree(worker);
+			continue;
+		}
+
+		worker->retiring = 0;
+
+		if(WIFSIGNALED(status)) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "%s (PID %i) was terminated by signal %i (%s)", worker->name.value, pid, WTERMSIG(status), strsignal(WTERMSIG(status)));
+		} else {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "%s (PID %i) exited with status %i", worker->name.value, pid, WEXITSTATUS(status));
+		}
+
+		PancakeScheduleWorkerRespawn(worker);
+	}
+}
+
+STATIC void PancakeReadWorkerMessages(PancakeWorker *worker) {
+	UByte instructions[16];
+	ssize_t length, i;
+
+	length = read(worker->masterSocket, instructions, sizeof(instructions));
+
+	// Worker is gone, it will be reaped on SIGCHLD
+	if(length <= 0) {
+		return;
+	}
+
+	for(i = 0; i < length; i++) {
+		if(worker->receivingLoad) {
+			worker->load = instructions[i];
+			worker->receivingLoad = 0;
+			continue;
+		}
+
+		switch(instructions[i]) {
+			case PANCAKE_WORKER_HEARTBEAT_INT:
+				worker->heartbeatPending = 0;
+				break;
+			case PANCAKE_WORKER_LOAD_INT:
+				worker->receivingLoad = 1;
+				break;
+		}
+	}
+}
+
+STATIC UByte PancakeScaleWorkers(UInt32 load, UInt16 numRunning, UNative now) {
+	static UNative highLoadSince = 0, lowLoadSince = 0;
+	PancakeWorker *worker;
+	UInt16 i;
+
+	if(load < PANCAKE_WORKER_SCALE_UP_LOAD) {
+		highLoadSince = 0;
+	} else if(!highLoadSince) {
+		highLoadSince = now;
+	}
+
+	if(load > PANCAKE_WORKER_SCALE_DOWN_LOAD) {
+		lowLoadSince = 0;
+	} else if(!lowLoadSince) {
+		lowLoadSince = now;
+	}
+
+	if(highLoadSince && now - highLoadSince >= PANCAKE_WORKER_SCALE_DELAY && numRunning < PancakeMainConfiguration.maxWorkers) {
+		highLoadSince = 0;
+
+		// Lookup free slot
+		for(i = 0; i < PancakeMainConfiguration.maxWorkers && PancakeWorkerRegistry[i]; i++);
+
+		if(i == PancakeMainConfiguration.maxWorkers) {
+			return 1;
+		}
+
+		worker = PancakeCreateWorker(i);
+
+		PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Average load of workers is %u%%, adding %s", load, worker->name.value);
+
+		switch(PancakeRunWorker(worker)) {
+			case 0:
+				PancakeFree(worker->name.value);
+				PancakeFree(worker);
+				break;
+			case 1:
+				PancakeWorkerRegistry[i] = worker;
+				break;
+			case 2:
+				// Worker process stopped
+				return 2;
+		}
+	} else if(lowLoadSince && now - lowLoadSince >= PANCAKE_WORKER_SCALE_DELAY && numRunning > PancakeMainConfiguration.workers) {
+		lowLoadSince = 0;
+
+		// Retire the running worker with the highest id
+		for(i = PancakeMainConfiguration.maxWorkers; i-- > 0;) {
+			worker = PancakeWorkerRegistry[i];
+
+			if(worker && !worker->retiring && !worker->respawnTime) {
+				PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Average load of workers is %u%%, retiring %s", load, worker->name.value);
+
+				write(worker->masterSocket, PANCAKE_WORKER_GRACEFUL_SHUTDOWN, sizeof(PANCAKE_WORKER_GRACEFUL_SHUTDOWN) - 1);
+				worker->retiring = 1;
+				break;
+			}
+		}
+	}
+
+	return 1;
+}
+
+PANCAKE_API void PancakeClosePreviousMaster(UByte retire) {
+	Byte *value = getenv(PANCAKE_WORKER_PREVIOUS_MASTER_ENV);
+	Int32 fd;
+
+	if(value == NULL) {
+		return;
+	}
+
+	fd = atoi(value);
+
+	// Previous master stops its workers gracefully and exits
+	if(retire) {
+		write(fd, PANCAKE_WORKER_GRACEFUL_SHUTDOWN, sizeof(PANCAKE_WORKER_GRACEFUL_SHUTDOWN) - 1);
+	}
+
+	close(fd);
+	unsetenv(PANCAKE_WORKER_PREVIOUS_MASTER_ENV);
+}
+
+STATIC void PancakeExecuteMaster() {
+	// Flush buffered log messages so that they are not written twice
+	fflush(NULL);
+
+	execv("/proc/self/exe", PancakeArguments);
+	execvp(PancakeArguments[0], PancakeArguments);
+}
+
+STATIC void PancakeReloadConfiguration() {
+	Byte value[12];
+	sigset_t signalSet;
+	Int32 sockets[2];
+	pid_t pid;
+	UInt16 i;
+
+	if(reloadSocket != -1) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Configuration is already being reloaded");
+		return;
+	}
+
+	PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Reloading configuration...");
+
+	// New master closes its end when it fails to start
+	if(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == -1) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't create sockets for internal communication: %s", strerror(errno));
+		return;
+	}
+
+	fflush(NULL);
+
+	// Run a new master, we keep serving until its workers run
+	pid = fork();
+
+	if(pid == -1) {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't fork: %s", strerror(errno));
+
+		close(sockets[0]);
+		close(sockets[1]);
+		return;
+	} else if(!pid) {
+		close(sockets[0]);
+
+		// Our workers must still notice when we are gone
+		for(i = 0; i < PancakeMainConfiguration.maxWorkers; i++) {
+			if(PancakeWorkerRegistry[i] && PancakeWorkerRegistry[i]->masterSocket != -1) {
+				close(PancakeWorkerRegistry[i]->masterSocket);
+			}
+		}
+
+		sprintf(value, "%i", sockets[1]);
+		setenv(PANCAKE_WORKER_PREVIOUS_MASTER_ENV, value, 1);
+
+		PancakeNetworkExportListenSockets();
+
+		// Signal mask is kept across exec
+		PancakeGetSupervisorSignals(&signalSet);
+		sigprocmask(SIG_UNBLOCK, &signalSet, NULL);
+
+		PancakeExecuteMaster();
+
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "Can't run %s: %s", PancakeArguments[0], strerror(errno));
+		_exit(2);
+	}
+
+	close(sockets[1]);
+
+	reloadPid = pid;
+	reloadSocket = sockets[0];
+}
+
+STATIC void PancakeFinishReload() {
 	UByte instruction;
 
-	read(sock->fd, &instruction, 1);
+	if(read(reloadSocket, &instruction, 1) == 1) {
+		// Workers of the new master are accepting, let ours finish their connections
+		PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "New configuration is running, stopping the workers of the previous one");
+		PancakeDoShutdown = 1;
+	} else {
+		PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "New configuration failed to start, keeping the current configuration");
+	}
+
+	close(reloadSocket);
+	reloadSocket = -1;
+	reloadPid = 0;
+}
+
+PANCAKE_API UByte PancakeSuperviseWorkers() {
+	struct pollfd fds[PancakeMainConfiguration.maxWorkers + 1];
+	PancakeWorker *polledWorkers[PancakeMainConfiguration.maxWorkers + 1];
+	UInt32 heartbeatInterval = PancakeMainConfiguration.workerHeartbeatTimeout / 2;
+	UByte scaling = PancakeMainConfiguration.maxWorkers > PancakeMainConfiguration.workers;
+	sigset_t signalSet, waitSignalSet;
+
+	if(!heartbeatInterval) {
+		heartbeatInterval = 1;
+	}
+
+	// Block signals while not waiting so that no worker exit, shutdown or reload request goes unnoticed
+	PancakeGetSupervisorSignals(&signalSet);
+	sigprocmask(SIG_BLOCK, &signalSet, &waitSignalSet);
+	sigdelset(&waitSignalSet, SIGCHLD);
+	sigdelset(&waitSignalSet, SIGINT);
+	sigdelset(&waitSignalSet, SIGTERM);
+	sigdelset(&waitSignalSet, SIGHUP);
+
+	// New workers are accepting, let the master of the previous configuration stop
+	PancakeClosePreviousMaster(1);
+
+	while(!PancakeDoShutdown) {
+		struct timespec timeout;
+		UNative now, wakeup = 0;
+		UInt16 i, numFDs = 0, numRunning = 0;
+		UInt32 load = 0;
+
+		if(PancakeDoReload) {
+			PancakeDoReload = 0;
+			PancakeReloadConfiguration();
+		}
+
+		PancakeUpdateNow();
+		PancakeReapWorkers();
+
+		now = PancakeNow();
+
+		for(i = 0; i < PancakeMainConfiguration.maxWorkers; i++) {
+			PancakeWorker *worker = PancakeWorkerRegistry[i];
+
+			if(worker == NULL) {
+				continue;
+			}
+
+			if(worker->respawnTime) {
+				if(worker->respawnTime <= now) {
+					PancakeLoggerFormat(PANCAKE_LOGGER_SYSTEM, 0, "Running %s again", worker->name.value);
+
+					switch(PancakeRunWorker(worker)) {
+						case 0:
+							// Try again later
+							worker->startTime = now;
+							PancakeScheduleWorkerRespawn(worker);
+							break;
+						case 2:
+							// Worker process stopped
+							return 2;
+					}
+				}
+
+				if(worker->respawnTime) {
+					if(!wakeup || worker->respawnTime < wakeup) {
+						wakeup = worker->respawnTime;
+					}
+
+					continue;
+				}
+			}
+
+			if(PancakeMainConfiguration.workerHeartbeatTimeout) {
+				UNative next;
+
+				if(worker->heartbeatPending) {
+					// Event loop of the worker is stuck, replace it
+					if(now - worker->heartbeatTime >= PancakeMainConfiguration.workerHeartbeatTimeout) {
+						PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "%s (PID %i) didn't answer heartbeat within %i seconds, killing it", worker->name.value, worker->pid, PancakeMainConfiguration.workerHeartbeatTimeout);
+
+						kill(worker->pid, SIGKILL);
+						worker->heartbeatPending = 0;
+
+						// Worker is run again after it was reaped
+						worker->heartbeatTime = now;
+						continue;
+					}
+
+					next = worker->heartbeatTime + PancakeMainConfiguration.workerHeartbeatTimeout;
+				} else if(now - worker->heartbeatTime >= heartbeatInterval) {
+					write(worker->masterSocket, PANCAKE_WORKER_HEARTBEAT, sizeof(PANCAKE_WORKER_HEARTBEAT) - 1);
+
+					worker->heartbeatTime = now;
+					worker->heartbeatPending = 1;
+
+					next = now + PancakeMainConfiguration.workerHeartbeatTimeout;
+				} else {
+					next = worker->heartbeatTime + heartbeatInterval;
+				}
+
+				if(!wakeup || next < wakeup) {
+					wakeup = next;
+				}
+			} else if(!scaling) {
+				continue;
+			}
+
+			if(!worker->retiring) {
+				numRunning++;
+				load += worker->load;
+			}
+
+			fds[numFDs].fd = worker->masterSocket;
+			fds[numFDs].events = POLLIN;
+			polledWorkers[numFDs] = worker;
+			numFDs++;
+		}
+
+		// Wait for the master running the new configuration
+		if(reloadSocket != -1) {
+			fds[numFDs].fd = reloadSocket;
+			fds[numFDs].events = POLLIN;
+			polledWorkers[numFDs] = NULL;
+			numFDs++;
+		}
+
+		// Add or retire workers depending on their average load
+		if(scaling && numRunning && PancakeScaleWorkers(load / numRunning, numRunning, now) == 2) {
+			return 2;
+		}
+
+		timeout.tv_sec = wakeup > now ? wakeup - now : 0;
+		timeout.tv_nsec = 0;
+
+		// Sleep until a worker exits, answers a heartbeat or needs attention
+		if(ppoll(fds, numFDs, wakeup ? &timeout : NULL, &waitSignalSet) > 0) {
+			for(i = 0; i < numFDs; i++) {
+				if(polledWorkers[i] == NULL) {
+					if(fds[i].revents & (POLLIN | POLLHUP)) {
+						PancakeFinishReload();
+					}
+				} else if(fds[i].revents & POLLIN) {
+					PancakeReadWorkerMessages(polledWorkers[i]);
+				}
+			}
+		}
+	}
+
+	// Master starting with the new configuration would keep running without us
+	if(reloadSocket != -1) {
+		kill(reloadPid, SIGTERM);
+
+		close(reloadSocket);
+		reloadSocket = -1;
+	}
+
+	sigprocmask(SIG_UNBLOCK, &signalSet, NULL);
+
+	return 1;
+}
+
+PANCAKE_API void PancakeStopWorkers() {
+	UInt16 i, numRunning = 0;
+	sigset_t signalSet, previousSignalSet;
+	UNative deadline;
+
+	for(i = 0; i < PancakeMainConfiguration.maxWorkers; i++) {
+		PancakeWorker *worker = PancakeWorkerRegistry[i];
+
+		// Worker is waiting to be run again
+		if(worker == NULL || worker->masterSocket == -1) {
+			continue;
+		}
+
+		write(worker->masterSocket, PANCAKE_WORKER_GRACEFUL_SHUTDOWN, sizeof(PANCAKE_WORKER_GRACEFUL_SHUTDOWN) - 1);
+		numRunning++;
+	}
+
+	// Block SIGCHLD so that no worker exit between waitpid() and sigtimedwait() goes unnoticed
+	sigemptyset(&signalSet);
+	sigaddset(&signalSet, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &signalSet, &previousSignalSet);
+
+	PancakeUpdateNow();
+	deadline = PancakeNow() + (PancakeMainConfiguration.shutdownTimeout > 0 ? PancakeMainConfiguration.shutdownTimeout : 0) + PANCAKE_WORKER_SHUTDOWN_GRACE;
+
+	// Wait for workers to finish their active connections
+	while(numRunning) {
+		struct timespec timeout;
+		Int32 status;
+		UNative now;
+		pid_t pid;
+
+		while((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			PancakeWorker *worker = PancakeLookupWorker(pid);
+
+			if(worker != NULL && worker->masterSocket != -1) {
+				close(worker->masterSocket);
+				worker->masterSocket = -1;
+				numRunning--;
+			}
+		}
+
+		if(!numRunning) {
+			break;
+		}
+
+		PancakeUpdateNow();
+		now = PancakeNow();
+
+		if(now >= deadline) {
+			PancakeLoggerFormat(PANCAKE_LOGGER_ERROR, 0, "%u workers didn't stop in time, killing them", numRunning);
+
+			for(i = 0; i < PancakeMainConfiguration.maxWorkers; i++) {
+				PancakeWorker *worker = PancakeWorkerRegistry[i];
+
+				if(worker != NULL && worker->masterSocket != -1) {
+					kill(worker->pid, SIGKILL);
+				}
+			}
 
-	switch(instruction) {
-		default:
-		case PANCAKE_WORKER_GRACEFUL_SHUTDOWN_INT:
-			PancakeDoShutdown = 1;
 			break;
+		}
+
+		timeout.tv_sec = deadline - now;
+		timeout.tv_nsec = 0;
+
+		sigtimedwait(&signalSet, NULL, &timeout);
 	}
+
+	sigprocmask(SIG_SETMASK, &previousSignalSet, NULL);
 }
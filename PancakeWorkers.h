@@ -7,19 +7,64 @@
 
 #define PANCAKE_WORKER_GRACEFUL_SHUTDOWN "\1"
 #define PANCAKE_WORKER_GRACEFUL_SHUTDOWN_INT '\1'
+#define PANCAKE_WORKER_HEARTBEAT "\2"
+#define PANCAKE_WORKER_HEARTBEAT_INT '\2'
+#define PANCAKE_WORKER_LOAD "\3" /* followed by a byte holding the load in percent */
+#define PANCAKE_WORKER_LOAD_INT '\3'
+
+/* Workers dying earlier after their start are considered crashing in a loop */
+#define PANCAKE_WORKER_CRASH_INTERVAL 10
+
+/* Maximum delay in seconds before running crashing workers again */
+#define PANCAKE_WORKER_MAX_RESPAWN_DELAY 60
+
+/* Seconds between load reports of workers while the amount of workers is scaled */
+#define PANCAKE_WORKER_LOAD_INTERVAL 1
+
+/* Average load in percent above which workers are added and below which they are retired */
+#define PANCAKE_WORKER_SCALE_UP_LOAD 80
+#define PANCAKE_WORKER_SCALE_DOWN_LOAD 30
+
+/* Seconds the load must stay beyond a threshold before workers are added or retired */
+#define PANCAKE_WORKER_SCALE_DELAY 10
+
+/* Environment variable passing the socket to the master we were started by to reload its configuration */
+#define PANCAKE_WORKER_PREVIOUS_MASTER_ENV "PANCAKE_PREVIOUS_MASTER"
+
+/* Seconds workers get beyond ShutdownTimeout to exit before they are killed */
+#define PANCAKE_WORKER_SHUTDOWN_GRACE 5
 
 typedef struct _PancakeWorker {
 	String name;
 	PancakeWorkerEntryFunction run;
 	Int32 pid;
+	UInt16 id; /* slot in worker registry */
+	Int32 cpu; /* CPU the worker is pinned to, -1 if none */
 
 	Int32 masterSocket;
 	PancakeSocket workerSocket;
 
 	UByte isMaster;
+
+	/* Supervision (master only) */
+	UNative startTime;
+	UNative respawnTime; /* 0 while the worker is running */
+	UInt32 numCrashes; /* subsequent crashes shortly after start */
+	UNative heartbeatTime; /* time the last heartbeat was sent */
+	UByte heartbeatPending;
+	UByte load; /* last reported load in percent */
+	UByte receivingLoad;
+	UByte retiring;
 } PancakeWorker;
 
+PANCAKE_API PancakeWorker *PancakeCreateWorker(UInt16 id);
 PANCAKE_API UByte PancakeRunWorker(PancakeWorker *worker);
+PANCAKE_API UByte PancakeSuperviseWorkers();
+PANCAKE_API void PancakeStopWorkers();
+PANCAKE_API void PancakeClosePreviousMaster(UByte retire);
+
+UByte PancakeWorkersAmountConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope);
+UByte PancakeWorkersCPUAffinityConfiguration(UByte step, config_setting_t *setting, PancakeConfigurationScope **scope);
 
 extern PancakeWorker *PancakeCurrentWorker;
 extern PancakeWorker **PancakeWorkerRegistry;
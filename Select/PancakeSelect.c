@@ -2,6 +2,7 @@
 #include "../PancakeLogger.h"
 #include "../PancakeNetwork.h"
 #include "../PancakeScheduler.h"
+#include "../PancakeDateTime.h"
 
 STATIC UByte PancakeSelectInitialize();
 STATIC void PancakeSelectWait();
@@ -55,6 +56,11 @@ PancakeServerArchitecture PancakeSelectServer = {
 
 		NULL,
 
+		NULL,
+		NULL,
+
+		NULL,
+
 		NULL
 };
 
@@ -200,15 +206,25 @@ STATIC void PancakeSelectWait() {
 		fd_set writeFDSet = PancakeSelectWriteFDSet;
 		Int32 numEvents;
 		struct timeval timeout;
+		UInt32 milliseconds;
 
-		timeout.tv_sec = PancakeSchedulerGetNextExecutionTimeOffset();
-		timeout.tv_usec = 0;
+		milliseconds = PancakeSchedulerGetNextExecutionTimeOffsetMilliseconds();
+		timeout.tv_sec = milliseconds / 1000;
+		timeout.tv_usec = (milliseconds % 1000) * 1000;
 
 		numEvents = select(PancakeSelectMaxFD + 1, &readFDSet, &writeFDSet, NULL, &timeout);
 
+		// Refresh cached clock once per iteration
+		PancakeUpdateNow();
+
 		if(UNEXPECTED(numEvents == -1)) {
+			// Let active connections finish before stopping
 			if(PancakeDoShutdown) {
-				return;
+				if(PancakeNetworkDrain()) {
+					return;
+				}
+
+				continue;
 			}
 
 			if(errno == EINTR) {
@@ -261,7 +277,7 @@ STATIC void PancakeSelectWait() {
 		// Scheduler events second
 		PancakeSchedulerRun();
 
-		if(UNEXPECTED(PancakeDoShutdown)) {
+		if(UNEXPECTED(PancakeDoShutdown) && PancakeNetworkDrain()) {
 			return;
 		}
 	}